@@ -1,69 +1,154 @@
 #include "XSbench_header.h"
+#include <immintrin.h>
 
-// Calculates the microscopic cross section for a given nuclide & energy
+// Reads the xs_ptrs entry of nuclide "nuc" at unionized grid row "idx",
+// decoding the compact index encodings on the fly
+template <int K>
+static inline long ueg_xs_ptr( GridPoint * energy_grid, LookupTables * lt,
+                               long n_isotopes, long idx, int nuc )
+{
+	int index_type = KERNEL_INDEX( K, lt );
+	if( index_type == INDEX_SHORT )
+		return lt->xs_u16[idx * n_isotopes + nuc];
+	else if( index_type == INDEX_DELTA )
+		return lt->xs_base[(idx / DELTA_BLOCK) * n_isotopes + nuc]
+		     + lt->xs_delta[idx * n_isotopes + nuc];
+	else
+		return energy_grid[idx].xs_ptrs[nuc];
+}
+
+// Returns the copy of nuclide grid point "flat" ([nuc * n_gridpoints + point])
+// that holds its XS in precision xs_t
+template <typename xs_t>
+static inline const typename XSStorage<xs_t>::point * xs_point( NuclideGridPoint ** nuclide_grids,
+                                                                LookupTables * lt, long flat );
+template <>
+inline const NuclideGridPoint * xs_point<double>( NuclideGridPoint ** nuclide_grids,
+                                                  LookupTables * lt, long flat )
+{
+	return &nuclide_grids[0][flat];
+}
+template <>
+inline const FloatGridPoint * xs_point<float>( NuclideGridPoint ** nuclide_grids,
+                                               LookupTables * lt, long flat )
+{
+	return &lt->float_grid[flat];
+}
+
+// Returns the concentration of nuclide j of material mat in precision xs_t
+template <typename xs_t>
+static inline xs_t xs_conc( double ** concs, LookupTables * lt, int mat, int j );
+template <>
+inline double xs_conc<double>( double ** concs, LookupTables * lt, int mat, int j )
+{
+	return concs[mat][j];
+}
+template <>
+inline float xs_conc<float>( double ** concs, LookupTables * lt, int mat, int j )
+{
+	return lt->float_concs[mat][j];
+}
+
+// Calculates the microscopic cross section for a given nuclide & energy.
+// xs_t is the precision the XS are stored and interpolated in, and picks
+// the copy of the nuclide grids that is searched and read. Unless GRID is
+// GRID_ANY it replaces grid_type, so the grid type branches fold away, as
+// do the index type and interpolation branches unless K is KERNEL_ANY.
+template <typename xs_t, int GRID, int K>
 void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
                            long n_gridpoints,
                            GridPoint *energy_grid,
                            NuclideGridPoint **nuclide_grids,
-                           long idx, double *xs_vector, int grid_type, int hash_bins ){
+                           long idx, xs_t *xs_vector, int grid_type, int hash_bins,
+                           LookupTables *lt ){
+	if( GRID != GRID_ANY )
+		grid_type = GRID;
+
 	// Variables
 	double f;
-	NuclideGridPoint * low, * high;
+	const typename XSStorage<xs_t>::point * grid, * low, * high;
+	grid = xs_point<xs_t>( nuclide_grids, lt, nuc * n_gridpoints );
 
 	// If using only the nuclide grid, we must perform a binary search
 	// to find the energy location in this particular nuclide's grid.
 	if( grid_type == NUCLIDE )
 	{
 		// Perform binary search on the Nuclide Grid to find the index
-		idx = grid_search_nuclide( n_gridpoints, p_energy, nuclide_grids[nuc], 0, n_gridpoints-1);
+		idx = grid_search_nuclide( n_gridpoints, p_energy, grid, 0, n_gridpoints-1);
 
 		// pull ptr from nuclide grid and check to ensure that
 		// we're not reading off the end of the nuclide's grid
 		if( idx == n_gridpoints - 1 )
-			low = &nuclide_grids[nuc][idx - 1];
+			low = &grid[idx - 1];
 		else
-			low = &nuclide_grids[nuc][idx];
+			low = &grid[idx];
 	}
 	else if( grid_type == UNIONIZED) // Unionized Energy Grid - we already know the index, no binary search needed.
 	{
 		// pull ptr from energy grid and check to ensure that
 		// we're not reading off the end of the nuclide's grid
-		if( energy_grid[idx].xs_ptrs[nuc] == n_gridpoints - 1 )
-			low = &nuclide_grids[nuc][energy_grid[idx].xs_ptrs[nuc] - 1];
+		// With the per-material index the caller has already read the
+		// nuclide's entry of the material's row, and passes it as idx
+		long xs_ptr = idx;
+		if( KERNEL_INDEX( K, lt ) != INDEX_MATERIAL )
+			xs_ptr = ueg_xs_ptr<K>( energy_grid, lt, n_isotopes, idx, nuc );
+		if( xs_ptr == n_gridpoints - 1 )
+			low = &grid[xs_ptr - 1];
 		else
-			low = &nuclide_grids[nuc][energy_grid[idx].xs_ptrs[nuc]];
+			low = &grid[xs_ptr];
 	}
 	else // Hash grid
 	{
-		// load lower bounding index
-		int u_low = energy_grid[idx].xs_ptrs[nuc];
-
-		// Determine higher bounding index
-		int u_high;
-		if( idx == hash_bins - 1 )
-			u_high = n_gridpoints - 1;
+		int u_low, u_high;
+		if( grid_type == LOGHASH )
+		{
+			// load the bin's (low, high) bounding indices
+			u_low = energy_grid[idx].xs_ptrs[2*nuc];
+			u_high = energy_grid[idx].xs_ptrs[2*nuc+1];
+		}
 		else
-			u_high = energy_grid[idx+1].xs_ptrs[nuc] + 1;
+		{
+			// load lower bounding index
+			u_low = energy_grid[idx].xs_ptrs[nuc];
+
+			// Determine higher bounding index
+			if( idx == hash_bins - 1 )
+				u_high = n_gridpoints - 1;
+			else
+				u_high = energy_grid[idx+1].xs_ptrs[nuc] + 1;
+		}
 
 		// Check edge cases to make sure energy is actually between these
 		// Then, if things look good, search for gridpoint in the nuclide grid
 		// within the lower and higher limits we've calculated.
-		double e_low  = nuclide_grids[nuc][u_low].energy;
-		double e_high = nuclide_grids[nuc][u_high].energy;
+		// (Rounding of the bin energies can leave the energy just outside
+		// the window, in which case the search is widened to that side.)
+		double e_low  = grid[u_low].energy;
+		double e_high = grid[u_high].energy;
 		int lower;
-		if( p_energy <= e_low )
-			lower = 0;
+		if( p_energy < e_low )
+			lower = grid_search_nuclide( n_gridpoints, p_energy, grid, 0, u_low);
 		else if( p_energy >= e_high )
-			lower = n_gridpoints - 1;
+			lower = grid_search_nuclide( n_gridpoints, p_energy, grid, u_high, n_gridpoints-1);
 		else
-			lower = grid_search_nuclide( n_gridpoints, p_energy, nuclide_grids[nuc], u_low, u_high);
+			lower = grid_search_nuclide( n_gridpoints, p_energy, grid, u_low, u_high);
 
 		if( lower == n_gridpoints - 1 )
-			low = &nuclide_grids[nuc][lower - 1];
+			low = &grid[lower - 1];
 		else
-			low = &nuclide_grids[nuc][lower];
+			low = &grid[lower];
 	}
 	
+	// The slope grid interpolates from the low point's record alone
+	if( KERNEL_INTERP( K, lt ) == INTERP_SLOPE )
+	{
+		SlopeGridPoint * s = &lt->slope_grid[nuc * n_gridpoints + (low - grid)];
+		double de = p_energy - s->energy;
+		for( int k = 0; k < 5; k++ )
+			xs_vector[k] = s->xs[k] + de * s->slope[k];
+		return;
+	}
+
 	high = low + 1;
 	
 	// calculate the re-useable interpolation factor
@@ -97,29 +182,64 @@ void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
 	
 }
 
-// Calculates macroscopic cross section based on a given material & energy 
-void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
-                         long n_gridpoints, int *  num_nucs,
-                         double **  concs,
-                         GridPoint *  energy_grid,
-                         NuclideGridPoint **  nuclide_grids,
-                         int **  mats,
-                         double *  macro_xs_vector, int grid_type, int hash_bins ){
-	double xs_vector[5];
-	int p_nuc; // the nuclide we are looking up
-	long idx = -1;	
-	double conc; // the concentration of the nuclide in the material
+// Looks up the macroscopic cross section of material mat from its macro
+// table (-T macro): one binary search and one interpolation
+static inline void calculate_macro_xs_table( double p_energy, int mat,
+                                             double * macro_xs_vector, LookupTables * lt )
+{
+	const MacroTable * t = &lt->macro_tables[mat];
+	long lowerLimit = 0;
+	long upperLimit = t->n - 1;
+	long examinationPoint;
+	long length = upperLimit - lowerLimit;
 
-	// cleans out macro_xs_vector
+	while( length > 1 )
+	{
+		examinationPoint = lowerLimit + ( length / 2 );
+
+		if( t->energy[examinationPoint] > p_energy )
+			upperLimit = examinationPoint;
+		else
+			lowerLimit = examinationPoint;
+
+		length = upperLimit - lowerLimit;
+	}
+
+	const double * low = &t->xs[5 * lowerLimit];
+	const double * high = low + 5;
+	double f = (t->energy[lowerLimit + 1] - p_energy)
+	         / (t->energy[lowerLimit + 1] - t->energy[lowerLimit]);
 	for( int k = 0; k < 5; k++ )
-		macro_xs_vector[k] = 0;
+		macro_xs_vector[k] = high[k] - f * (high[k] - low[k]);
+}
+
+// Finds the row of energy_grid used by the lookups of p_energy. For the
+// nuclide grid there is no such row, and -1 is returned.
+template <int GRID, int K>
+static inline long macro_xs_index( double p_energy, long n_isotopes,
+                                   long n_gridpoints, GridPoint * energy_grid,
+                                   int grid_type, int hash_bins, LookupTables * lt )
+{
+	if( GRID != GRID_ANY )
+		grid_type = GRID;
+	int search_type = KERNEL_SEARCH( K, lt );
+
+	long idx = -1;
 
 	// If we are using the unionized energy grid (UEG), we only
 	// need to perform 1 binary search per macroscopic lookup.
 	// If we are using the nuclide grid search, it will have to be
 	// done inside of the "calculate_micro_xs" function for each different
 	// nuclide in the material.
-	if( grid_type == UNIONIZED )
+	if( grid_type == UNIONIZED && search_type == SEARCH_EYTZINGER )
+		idx = grid_search_eytzinger( n_isotopes * n_gridpoints, p_energy,
+		                             lt->eyt_energy, lt->eyt_index );
+	else if( grid_type == UNIONIZED && search_type == SEARCH_BSCACHE )
+		idx = grid_search_bscache( n_isotopes * n_gridpoints, p_energy,
+		                           energy_grid, lt );
+	else if( grid_type == UNIONIZED && search_type == SEARCH_KARY )
+		idx = grid_search_kary( n_isotopes * n_gridpoints, p_energy, lt );
+	else if( grid_type == UNIONIZED )
 		idx = grid_search( n_isotopes * n_gridpoints, p_energy,
 	    	               energy_grid);	
 	else if( grid_type == HASH )
@@ -127,7 +247,244 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 		double du = 1.0 / hash_bins;
 		idx = p_energy / du;
 	}
-	
+	else if( grid_type == LOGHASH )
+	{
+		double bin = (log(p_energy) - lt->loghash_log_min) * lt->loghash_inv_dlog;
+		if( !(bin > 0) )
+			idx = 0;
+		else if( bin >= hash_bins )
+			idx = hash_bins - 1;
+		else
+			idx = bin;
+	}
+
+	return idx;
+}
+
+// Adds conc[j] * micro XS of nuclides nucs[j], j in [start, n_nucs), to
+// macro_xs_vector using the simd_energy / simd_xs views of the nuclide grids
+template <int K>
+static void accumulate_simd_scalar( double p_energy, int * nucs, double * conc,
+                                    int start, int n_nucs, long n_isotopes,
+                                    long n_gridpoints, GridPoint * energy_grid,
+                                    long idx, double * macro_xs_vector,
+                                    LookupTables * lt )
+{
+	for( int j = start; j < n_nucs; j++ )
+	{
+		long xs_ptr = ueg_xs_ptr<K>( energy_grid, lt, n_isotopes, idx, nucs[j] );
+		if( xs_ptr == n_gridpoints - 1 )
+			xs_ptr--;
+		long low = (nucs[j] * n_gridpoints + xs_ptr) * lt->simd_stride;
+
+		double e_high = lt->simd_energy[low + lt->simd_stride];
+		double f = (e_high - p_energy) / (e_high - lt->simd_energy[low]);
+		for( int k = 0; k < 5; k++ )
+		{
+			double high = lt->simd_xs[k][low + lt->simd_stride];
+			macro_xs_vector[k] += (high - f * (high - lt->simd_xs[k][low])) * conc[j];
+		}
+	}
+}
+
+// Loads the xs_ptrs of nuclides nucs[0 .. lanes-1] at row idx one at a
+// time, for the compact index encodings that can not be gathered
+template <int K>
+static inline void load_simd_xs_ptrs( int * nucs, int lanes, long n_isotopes,
+                                      GridPoint * energy_grid, long idx,
+                                      int * xs_ptrs, LookupTables * lt )
+{
+	for( int l = 0; l < lanes; l++ )
+		xs_ptrs[l] = ueg_xs_ptr<K>( energy_grid, lt, n_isotopes, idx, nucs[l] );
+}
+
+// Gathers base[index[i]] into every lane. The masked gathers take an
+// explicit zeroed source, where the plain intrinsics leave it undefined
+// and trip -Wmaybe-uninitialized.
+__attribute__((target("avx2")))
+static inline __m256d gather4_pd( const double * base, __m128i index )
+{
+	__m256d zero = _mm256_setzero_pd();
+	return _mm256_mask_i32gather_pd( zero, base, index,
+	                                 _mm256_cmp_pd( zero, zero, _CMP_EQ_OQ ), 8 );
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d gather8_pd( const double * base, __m256i index )
+{
+	return _mm512_mask_i32gather_pd( _mm512_setzero_pd(), 0xFF, index, base, 8 );
+}
+
+// AVX2 version of accumulate_simd_scalar, 4 nuclides per instruction.
+// Each lane does the same operations as the scalar code (no FMA), and the
+// lanes are summed in nuclide order, so the results are identical. The
+// gather offsets are 32-bit, so read_CLI rejects grids of 2^31 /
+// simd_stride points or more.
+template <int K>
+__attribute__((target("avx2")))
+static void accumulate_simd_avx2( double p_energy, int * nucs, double * conc,
+                                  int n_nucs, long n_isotopes, long n_gridpoints,
+                                  GridPoint * energy_grid, long idx,
+                                  double * macro_xs_vector, LookupTables * lt )
+{
+	__m256d e = _mm256_set1_pd( p_energy );
+	__m128i last = _mm_set1_epi32( n_gridpoints - 2 );
+	__m128i stride = _mm_set1_epi32( n_gridpoints );
+	__m128i point_stride = _mm_set1_epi32( lt->simd_stride );
+	int s = lt->simd_stride;
+	double contrib[5][4] __attribute__((aligned(32)));
+	int xs_ptrs[4] __attribute__((aligned(16)));
+
+	int j = 0;
+	for( ; j + 4 <= n_nucs; j += 4 )
+	{
+		__m128i nuc = _mm_loadu_si128( (__m128i *) &nucs[j] );
+		__m128i ptr;
+		if( KERNEL_INDEX( K, lt ) == INDEX_INT )
+			ptr = _mm_i32gather_epi32( energy_grid[idx].xs_ptrs, nuc, 4 );
+		else
+		{
+			load_simd_xs_ptrs<K>( &nucs[j], 4, n_isotopes, energy_grid, idx, xs_ptrs, lt );
+			ptr = _mm_load_si128( (__m128i *) xs_ptrs );
+		}
+		ptr = _mm_min_epi32( ptr, last );
+		__m128i low = _mm_add_epi32( _mm_mullo_epi32( nuc, stride ), ptr );
+		low = _mm_mullo_epi32( low, point_stride );
+
+		__m256d e_low  = gather4_pd( lt->simd_energy, low );
+		__m256d e_high = gather4_pd( lt->simd_energy + s, low );
+		__m256d f = _mm256_div_pd( _mm256_sub_pd( e_high, e ), _mm256_sub_pd( e_high, e_low ) );
+		__m256d c = _mm256_loadu_pd( &conc[j] );
+		for( int k = 0; k < 5; k++ )
+		{
+			__m256d xs_low  = gather4_pd( lt->simd_xs[k], low );
+			__m256d xs_high = gather4_pd( lt->simd_xs[k] + s, low );
+			__m256d xs = _mm256_sub_pd( xs_high, _mm256_mul_pd( f, _mm256_sub_pd( xs_high, xs_low ) ) );
+			_mm256_store_pd( contrib[k], _mm256_mul_pd( xs, c ) );
+		}
+		for( int l = 0; l < 4; l++ )
+			for( int k = 0; k < 5; k++ )
+				macro_xs_vector[k] += contrib[k][l];
+	}
+
+	accumulate_simd_scalar<K>( p_energy, nucs, conc, j, n_nucs, n_isotopes,
+	                       n_gridpoints, energy_grid, idx, macro_xs_vector, lt );
+}
+
+// AVX-512 version of accumulate_simd_scalar, 8 nuclides per instruction.
+// AVX-512 implies FMA, which is kept from fusing the interpolation so the
+// results stay identical to the scalar code.
+template <int K>
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void accumulate_simd_avx512( double p_energy, int * nucs, double * conc,
+                                    int n_nucs, long n_isotopes, long n_gridpoints,
+                                    GridPoint * energy_grid, long idx,
+                                    double * macro_xs_vector, LookupTables * lt )
+{
+	__m512d e = _mm512_set1_pd( p_energy );
+	__m256i last = _mm256_set1_epi32( n_gridpoints - 2 );
+	__m256i stride = _mm256_set1_epi32( n_gridpoints );
+	__m256i point_stride = _mm256_set1_epi32( lt->simd_stride );
+	int s = lt->simd_stride;
+	double contrib[5][8] __attribute__((aligned(64)));
+	int xs_ptrs[8] __attribute__((aligned(32)));
+
+	int j = 0;
+	for( ; j + 8 <= n_nucs; j += 8 )
+	{
+		__m256i nuc = _mm256_loadu_si256( (__m256i *) &nucs[j] );
+		__m256i ptr;
+		if( KERNEL_INDEX( K, lt ) == INDEX_INT )
+			ptr = _mm256_i32gather_epi32( energy_grid[idx].xs_ptrs, nuc, 4 );
+		else
+		{
+			load_simd_xs_ptrs<K>( &nucs[j], 8, n_isotopes, energy_grid, idx, xs_ptrs, lt );
+			ptr = _mm256_load_si256( (__m256i *) xs_ptrs );
+		}
+		ptr = _mm256_min_epi32( ptr, last );
+		__m256i low = _mm256_add_epi32( _mm256_mullo_epi32( nuc, stride ), ptr );
+		low = _mm256_mullo_epi32( low, point_stride );
+
+		__m512d e_low  = gather8_pd( lt->simd_energy, low );
+		__m512d e_high = gather8_pd( lt->simd_energy + s, low );
+		__m512d f = _mm512_div_pd( _mm512_sub_pd( e_high, e ), _mm512_sub_pd( e_high, e_low ) );
+		__m512d c = _mm512_loadu_pd( &conc[j] );
+		for( int k = 0; k < 5; k++ )
+		{
+			__m512d xs_low  = gather8_pd( lt->simd_xs[k], low );
+			__m512d xs_high = gather8_pd( lt->simd_xs[k] + s, low );
+			__m512d xs = _mm512_sub_pd( xs_high, _mm512_mul_pd( f, _mm512_sub_pd( xs_high, xs_low ) ) );
+			_mm512_store_pd( contrib[k], _mm512_mul_pd( xs, c ) );
+		}
+		for( int l = 0; l < 8; l++ )
+			for( int k = 0; k < 5; k++ )
+				macro_xs_vector[k] += contrib[k][l];
+	}
+
+	accumulate_simd_scalar<K>( p_energy, nucs, conc, j, n_nucs, n_isotopes,
+	                       n_gridpoints, energy_grid, idx, macro_xs_vector, lt );
+}
+
+// Picks the widest SIMD the CPU supports for the structure of arrays lookups
+void select_simd_isa( LookupTables * lt )
+{
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx512f") )
+	{
+		lt->simd_isa = ISA_AVX512;
+		printf("Using AVX-512 nuclide gathers\n");
+	}
+	else if( __builtin_cpu_supports("avx2") )
+	{
+		lt->simd_isa = ISA_AVX2;
+		printf("Using AVX2 nuclide gathers\n");
+	}
+	else
+	{
+		lt->simd_isa = ISA_SCALAR;
+		printf("Using scalar nuclide lookups\n");
+	}
+}
+
+// Sums the micro XS of the nuclides of material mat, found from row idx
+// of energy_grid, into macro_xs_vector
+template <typename xs_t, int GRID, int K>
+static inline void accumulate_macro_xs( double p_energy, int mat, long n_isotopes,
+                                        long n_gridpoints, int * num_nucs,
+                                        double ** concs, GridPoint * energy_grid,
+                                        NuclideGridPoint ** nuclide_grids, int ** mats,
+                                        long idx, double * macro_xs_vector,
+                                        int grid_type, int hash_bins, LookupTables * lt )
+{
+	if( GRID != GRID_ANY )
+		grid_type = GRID;
+
+	xs_t xs_vector[5];
+	int p_nuc; // the nuclide we are looking up
+	xs_t conc; // the concentration of the nuclide in the material
+
+	// cleans out macro_xs_vector
+	for( int k = 0; k < 5; k++ )
+		macro_xs_vector[k] = 0;
+
+	// The SIMD layouts interpolate several nuclides at once
+	if( grid_type == UNIONIZED && KERNEL_LAYOUT( K, lt ) != LAYOUT_AOS )
+	{
+		if( lt->simd_isa == ISA_AVX512 )
+			accumulate_simd_avx512<K>( p_energy, mats[mat], concs[mat], num_nucs[mat],
+			                       n_isotopes, n_gridpoints, energy_grid, idx,
+			                       macro_xs_vector, lt );
+		else if( lt->simd_isa == ISA_AVX2 )
+			accumulate_simd_avx2<K>( p_energy, mats[mat], concs[mat], num_nucs[mat],
+			                     n_isotopes, n_gridpoints, energy_grid, idx,
+			                     macro_xs_vector, lt );
+		else
+			accumulate_simd_scalar<K>( p_energy, mats[mat], concs[mat], 0, num_nucs[mat],
+			                       n_isotopes, n_gridpoints, energy_grid, idx,
+			                       macro_xs_vector, lt );
+		return;
+	}
+
 	// printf("mat: %d, p_energy: %f, idx: %ld\n", mat, p_energy, idx);
 	// Once we find the pointer array on the UEG, we can pull the data
 	// from the respective nuclide grids, as well as the nuclide
@@ -139,16 +496,51 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 	// (Independent -- though if parallelizing, must use atomic operations
 	//  or otherwise control access to the xs_vector and macro_xs_vector to
 	//  avoid simulataneous writing to the same data structure)
+	// The per-material index holds the material's xs_ptrs in one dense row
+	const int * mat_row = NULL;
+	if( grid_type == UNIONIZED && KERNEL_INDEX( K, lt ) == INDEX_MATERIAL )
+		mat_row = &lt->mat_xs[mat][idx * num_nucs[mat]];
+
 	for( int j = 0; j < num_nucs[mat]; j++ )
 	{
 		p_nuc = mats[mat][j];
-		conc = concs[mat][j];
-		calculate_micro_xs( p_energy, p_nuc, n_isotopes,
-		                    n_gridpoints, energy_grid,
-		                    nuclide_grids, idx, xs_vector, grid_type, hash_bins );
+		conc = xs_conc<xs_t>( concs, lt, mat, j );
+		calculate_micro_xs<xs_t, GRID, K>( p_energy, p_nuc, n_isotopes,
+		                                   n_gridpoints, energy_grid,
+		                                   nuclide_grids, mat_row ? mat_row[j] : idx,
+		                                   xs_vector, grid_type, hash_bins, lt );
 		for( int k = 0; k < 5; k++ )
-			macro_xs_vector[k] += xs_vector[k] * conc;
+			macro_xs_vector[k] += (double) xs_vector[k] * conc;
 	}
+}
+
+// Calculates macroscopic cross section based on a given material & energy.
+// With xs_t = float the micro XS and concentrations are read from the
+// mixed precision copies in lt, and summed in double. GRID specialises the
+// lookup on one grid type, and K on the index, search, layout and
+// interpolation (see
+// calculate_micro_xs).
+template <typename xs_t, int GRID, int K>
+void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
+                         long n_gridpoints, int *  num_nucs,
+                         double **  concs,
+                         GridPoint *  energy_grid,
+                         NuclideGridPoint **  nuclide_grids,
+                         int **  mats,
+                         double *  macro_xs_vector, int grid_type, int hash_bins,
+                         LookupTables *  lt ){
+	if( GRID == GRID_MACRO )
+	{
+		calculate_macro_xs_table( p_energy, mat, macro_xs_vector, lt );
+		return;
+	}
+
+	long idx = macro_xs_index<GRID, K>( p_energy, n_isotopes, n_gridpoints, energy_grid,
+	                                    grid_type, hash_bins, lt );
+
+	accumulate_macro_xs<xs_t, GRID, K>( p_energy, mat, n_isotopes, n_gridpoints, num_nucs,
+	                                    concs, energy_grid, nuclide_grids, mats, idx,
+	                                    macro_xs_vector, grid_type, hash_bins, lt );
 	
 	//test
 	/*
@@ -158,6 +550,299 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 	*/
 }
 
+// calculate_macro_xs for lookups made in increasing energy order. On the
+// unionized grid the search gallops from *hint, the row found by the
+// previous lookup, which is then replaced by this lookup's row. Nearby
+// energies then cost a few comparisons on cache lines that were just read,
+// whichever search_type is set. The other grid types ignore the hint.
+template <typename xs_t, int GRID, int K>
+void calculate_macro_xs_hint( double p_energy, int mat, long n_isotopes,
+                              long n_gridpoints, int * num_nucs,
+                              double ** concs, GridPoint * energy_grid,
+                              NuclideGridPoint ** nuclide_grids, int ** mats,
+                              double * macro_xs_vector, int grid_type, int hash_bins,
+                              LookupTables * lt, long * hint )
+{
+	if( GRID == GRID_MACRO )
+	{
+		calculate_macro_xs_table( p_energy, mat, macro_xs_vector, lt );
+		return;
+	}
+	if( GRID != GRID_ANY )
+		grid_type = GRID;
+
+	long idx;
+	if( grid_type == UNIONIZED )
+	{
+		idx = grid_search_hint( n_isotopes * n_gridpoints, p_energy, energy_grid, *hint );
+		*hint = idx;
+	}
+	else
+		idx = macro_xs_index<GRID, K>( p_energy, n_isotopes, n_gridpoints, energy_grid,
+		                               grid_type, hash_bins, lt );
+
+	accumulate_macro_xs<xs_t, GRID, K>( p_energy, mat, n_isotopes, n_gridpoints, num_nucs,
+	                                    concs, energy_grid, nuclide_grids, mats, idx,
+	                                    macro_xs_vector, grid_type, hash_bins, lt );
+}
+
+// Calculates the macroscopic cross sections of n lookups of material mat,
+// the lookups ids[0 .. n-1] of an energy sorted bank. Lookup id's energy
+// is p_energy[id] and its XS are written to macro_xs_vectors[5*id ..
+// 5*id+4]. Results are identical to calling calculate_macro_xs on each.
+//
+// Without a unionized grid, materials with more than QUEUE_NUCLIDE_MAJOR
+// nuclides (the fuel) are looked up nuclide by nuclide, MAX_BATCH lookups
+// at a time, so each nuclide's grid is searched in order of increasing
+// energy while it is in cache. Everything else is looked up one lookup at
+// a time, as the unionized grid rows are read whole by each lookup. The
+// unionized grid searches start from *hint.
+template <typename xs_t, int GRID, int K>
+void calculate_macro_xs_queue( const int * ids, int n, const double * p_energy, int mat,
+                               long n_isotopes, long n_gridpoints, int * num_nucs,
+                               double ** concs, GridPoint * energy_grid,
+                               NuclideGridPoint ** nuclide_grids, int ** mats,
+                               double * macro_xs_vectors, int grid_type, int hash_bins,
+                               LookupTables * lt, long * hint )
+{
+	if( GRID == GRID_MACRO )
+	{
+		for( int i = 0; i < n; i++ )
+			calculate_macro_xs_table( p_energy[ids[i]], mat, &macro_xs_vectors[5 * ids[i]], lt );
+		return;
+	}
+	if( GRID != GRID_ANY )
+		grid_type = GRID;
+
+	if( num_nucs[mat] <= QUEUE_NUCLIDE_MAJOR || grid_type == UNIONIZED )
+	{
+		for( int i = 0; i < n; i++ )
+			calculate_macro_xs_hint<xs_t, GRID, K>( p_energy[ids[i]], mat, n_isotopes, n_gridpoints,
+			                                        num_nucs, concs, energy_grid, nuclide_grids, mats,
+			                                        &macro_xs_vectors[5 * ids[i]], grid_type,
+			                                        hash_bins, lt, hint );
+		return;
+	}
+
+	long idx[MAX_BATCH];
+	xs_t xs_vector[5];
+	for( int b = 0; b < n; b += MAX_BATCH )
+	{
+		int m = n - b;
+		if( m > MAX_BATCH )
+			m = MAX_BATCH;
+		const int * batch_ids = &ids[b];
+
+		for( int i = 0; i < m; i++ )
+		{
+			idx[i] = macro_xs_index<GRID, K>( p_energy[batch_ids[i]], n_isotopes, n_gridpoints,
+			                                  energy_grid, grid_type, hash_bins, lt );
+
+			for( int k = 0; k < 5; k++ )
+				macro_xs_vectors[5 * batch_ids[i] + k] = 0;
+		}
+
+		// Each lookup still sums its nuclides in mats order
+		for( int j = 0; j < num_nucs[mat]; j++ )
+		{
+			int p_nuc = mats[mat][j];
+			xs_t conc = xs_conc<xs_t>( concs, lt, mat, j );
+			for( int i = 0; i < m; i++ )
+			{
+				int id = batch_ids[i];
+				calculate_micro_xs<xs_t, GRID, K>( p_energy[id], p_nuc, n_isotopes,
+				                                   n_gridpoints, energy_grid,
+				                                   nuclide_grids, idx[i], xs_vector, grid_type,
+				                                   hash_bins, lt );
+				for( int k = 0; k < 5; k++ )
+					macro_xs_vectors[5 * id + k] += (double) xs_vector[k] * conc;
+			}
+		}
+	}
+}
+
+// Prefetches the xs_ptrs entries of material mat's nuclides at row idx
+template <int K>
+static inline void prefetch_xs_ptrs( GridPoint * energy_grid, LookupTables * lt,
+                                     long n_isotopes, long idx, int mat, int * mat_nucs,
+                                     int n_nucs )
+{
+	int index_type = KERNEL_INDEX( K, lt );
+	if( index_type == INDEX_MATERIAL )
+	{
+		int * row = &lt->mat_xs[mat][idx * n_nucs];
+		for( int j = 0; j < n_nucs; j += 64 / sizeof(int) )
+			__builtin_prefetch( &row[j] );
+		__builtin_prefetch( &row[n_nucs - 1] );
+		return;
+	}
+
+	for( int j = 0; j < n_nucs; j++ )
+	{
+		int nuc = mat_nucs[j];
+		if( index_type == INDEX_SHORT )
+			__builtin_prefetch( &lt->xs_u16[idx * n_isotopes + nuc] );
+		else if( index_type == INDEX_DELTA )
+			__builtin_prefetch( &lt->xs_delta[idx * n_isotopes + nuc] );
+		else
+			__builtin_prefetch( &energy_grid[idx].xs_ptrs[nuc] );
+	}
+}
+
+// Prefetches the nuclide grid points material mat's nuclides interpolate
+// between at row idx. Their xs_ptrs should already be in cache.
+template <typename xs_t, int K>
+static inline void prefetch_nuclide_points( GridPoint * energy_grid,
+                                            NuclideGridPoint ** nuclide_grids,
+                                            LookupTables * lt, long n_isotopes,
+                                            long idx, int mat, int * mat_nucs, int n_nucs )
+{
+	for( int j = 0; j < n_nucs; j++ )
+	{
+		int nuc = mat_nucs[j];
+		long xs_ptr;
+		if( KERNEL_INDEX( K, lt ) == INDEX_MATERIAL )
+			xs_ptr = lt->mat_xs[mat][idx * n_nucs + j];
+		else
+			xs_ptr = ueg_xs_ptr<K>( energy_grid, lt, n_isotopes, idx, nuc );
+		// gpmatrix stores the grids contiguously, as do the other copies
+		long k = &nuclide_grids[nuc][xs_ptr] - nuclide_grids[0];
+		if( KERNEL_INTERP( K, lt ) == INTERP_SLOPE )
+		{
+			SlopeGridPoint * s = &lt->slope_grid[k];
+			__builtin_prefetch( s );
+			__builtin_prefetch( (char *) s + sizeof(SlopeGridPoint) - 1 );
+		}
+		else if( KERNEL_LAYOUT( K, lt ) == LAYOUT_SOA )
+		{
+			__builtin_prefetch( &lt->simd_energy[k] );
+			for( int c = 0; c < 5; c++ )
+				__builtin_prefetch( &lt->simd_xs[c][k] );
+		}
+		else
+			__builtin_prefetch( xs_point<xs_t>( nuclide_grids, lt, k ) );
+	}
+}
+
+// Calculates the macroscopic cross sections of n lookups (at most
+// MAX_BATCH) at once, writing lookup i's to macro_xs_vectors[5*i .. 5*i+4].
+// Results are identical to calling calculate_macro_xs on each lookup.
+//
+// Instead of one fully dependent lookup at a time, the binary searches of
+// the unionized grid are interleaved: each round advances every search by
+// one step and prefetches the energy it will compare next, so up to n
+// cache misses are in flight at once (group prefetching). The nuclide
+// gathers are then software pipelined, with the xs_ptrs of lookup i+2
+// and the nuclide grid points of lookup i+1 prefetched while lookup i is
+// interpolated. The other grid types and searches use their own search
+// and only get the pipelined gathers.
+template <typename xs_t, int GRID, int K>
+void calculate_macro_xs_batch( double * p_energy, int * mat, int n,
+                               long n_isotopes, long n_gridpoints,
+                               int * num_nucs, double ** concs,
+                               GridPoint * energy_grid,
+                               NuclideGridPoint ** nuclide_grids, int ** mats,
+                               double * macro_xs_vectors, int grid_type, int hash_bins,
+                               LookupTables * lt )
+{
+	if( GRID == GRID_MACRO )
+	{
+		for( int i = 0; i < n; i++ )
+			calculate_macro_xs_table( p_energy[i], mat[i], &macro_xs_vectors[5*i], lt );
+		return;
+	}
+	if( GRID != GRID_ANY )
+		grid_type = GRID;
+
+	long idx[MAX_BATCH];
+
+	if( grid_type == UNIONIZED && KERNEL_SEARCH( K, lt ) == SEARCH_BINARY )
+	{
+		long lowerLimit[MAX_BATCH];
+		long upperLimit[MAX_BATCH];
+		long n_grid = n_isotopes * n_gridpoints;
+		for( int i = 0; i < n; i++ )
+		{
+			lowerLimit[i] = 0;
+			upperLimit[i] = n_grid - 1;
+			__builtin_prefetch( &energy_grid[(n_grid - 1) / 2] );
+		}
+
+		// Same steps as grid_search, taken by all searches in lockstep
+		int active = n;
+		while( active > 0 )
+		{
+			active = 0;
+			for( int i = 0; i < n; i++ )
+			{
+				long length = upperLimit[i] - lowerLimit[i];
+				if( length <= 1 )
+					continue;
+
+				long examinationPoint = lowerLimit[i] + ( length / 2 );
+				if( energy_grid[examinationPoint].energy > p_energy[i] )
+					upperLimit[i] = examinationPoint;
+				else
+					lowerLimit[i] = examinationPoint;
+
+				length = upperLimit[i] - lowerLimit[i];
+				if( length > 1 )
+				{
+					__builtin_prefetch( &energy_grid[lowerLimit[i] + length / 2] );
+					active++;
+				}
+			}
+		}
+
+		for( int i = 0; i < n; i++ )
+			idx[i] = lowerLimit[i];
+	}
+	else
+	{
+		for( int i = 0; i < n; i++ )
+			idx[i] = macro_xs_index<GRID, K>( p_energy[i], n_isotopes, n_gridpoints,
+			                                  energy_grid, grid_type, hash_bins, lt );
+	}
+
+	int pipeline = ( grid_type == UNIONIZED );
+	if( pipeline && n > 0 )
+		prefetch_xs_ptrs<K>( energy_grid, lt, n_isotopes, idx[0], mat[0], mats[mat[0]], num_nucs[mat[0]] );
+	if( pipeline && n > 1 )
+		prefetch_xs_ptrs<K>( energy_grid, lt, n_isotopes, idx[1], mat[1], mats[mat[1]], num_nucs[mat[1]] );
+	if( pipeline && n > 0 )
+		prefetch_nuclide_points<xs_t, K>( energy_grid, nuclide_grids, lt, n_isotopes,
+		                                  idx[0], mat[0], mats[mat[0]], num_nucs[mat[0]] );
+
+	for( int i = 0; i < n; i++ )
+	{
+		if( pipeline && i + 2 < n )
+			prefetch_xs_ptrs<K>( energy_grid, lt, n_isotopes, idx[i+2], mat[i+2],
+			                     mats[mat[i+2]], num_nucs[mat[i+2]] );
+		if( pipeline && i + 1 < n )
+			prefetch_nuclide_points<xs_t, K>( energy_grid, nuclide_grids, lt, n_isotopes,
+			                                  idx[i+1], mat[i+1], mats[mat[i+1]], num_nucs[mat[i+1]] );
+
+		accumulate_macro_xs<xs_t, GRID, K>( p_energy[i], mat[i], n_isotopes, n_gridpoints,
+		                                    num_nucs, concs, energy_grid, nuclide_grids, mats,
+		                                    idx[i], &macro_xs_vectors[5*i], grid_type, hash_bins, lt );
+	}
+}
+
+// Every lookup kernel in FOR_EACH_KERNEL
+#define INSTANTIATE_LOOKUPS( xs_t, GRID, K ) \
+template void calculate_macro_xs<xs_t, GRID, K>( double, int, long, long, int *, double **, GridPoint *, \
+                                                 NuclideGridPoint **, int **, double *, int, int, \
+                                                 LookupTables * ); \
+template void calculate_macro_xs_batch<xs_t, GRID, K>( double *, int *, int, long, long, int *, double **, \
+                                                       GridPoint *, NuclideGridPoint **, int **, double *, \
+                                                       int, int, LookupTables * ); \
+template void calculate_macro_xs_hint<xs_t, GRID, K>( double, int, long, long, int *, double **, GridPoint *, \
+                                                      NuclideGridPoint **, int **, double *, int, int, \
+                                                      LookupTables *, long * ); \
+template void calculate_macro_xs_queue<xs_t, GRID, K>( const int *, int, const double *, int, long, long, \
+                                                       int *, double **, GridPoint *, NuclideGridPoint **, \
+                                                       int **, double *, int, int, LookupTables *, long * );
+FOR_EACH_KERNEL( INSTANTIATE_LOOKUPS )
 
 // (fixed) binary search for energy on unionized energy grid
 // returns lower index
@@ -183,8 +868,218 @@ long grid_search( long n, double quarry, GridPoint * A)
 	return lowerLimit;
 }
 
+// Search for energy on unionized energy grid starting from row hint.
+// Gallops away from hint in doubling steps until quarry is bracketed,
+// then binary searches the bracket. Returns the same index as grid_search,
+// in O(log d) steps for a quarry d rows away from hint.
+long grid_search_hint( long n, double quarry, GridPoint * A, long hint )
+{
+	long lowerLimit, upperLimit;
+	long examinationPoint;
+	long step = 1;
+
+	if( hint < 0 )
+		hint = 0;
+	if( hint > n-2 )
+		hint = n-2;
+
+	// Rows 0 and n-1 are never compared by grid_search, so they bound the
+	// bracket whatever their energy
+	if( A[hint].energy > quarry )
+	{
+		upperLimit = hint;
+		lowerLimit = hint - step;
+		while( lowerLimit > 0 && A[lowerLimit].energy > quarry )
+		{
+			upperLimit = lowerLimit;
+			step *= 2;
+			lowerLimit = hint - step;
+		}
+		if( lowerLimit < 0 )
+			lowerLimit = 0;
+	}
+	else
+	{
+		lowerLimit = hint;
+		upperLimit = hint + step;
+		while( upperLimit < n-1 && A[upperLimit].energy <= quarry )
+		{
+			lowerLimit = upperLimit;
+			step *= 2;
+			upperLimit = hint + step;
+		}
+		if( upperLimit > n-1 )
+			upperLimit = n-1;
+	}
+
+	long length = upperLimit - lowerLimit;
+	while( length > 1 )
+	{
+		examinationPoint = lowerLimit + ( length / 2 );
+
+		if( A[examinationPoint].energy > quarry )
+			upperLimit = examinationPoint;
+		else
+			lowerLimit = examinationPoint;
+
+		length = upperLimit - lowerLimit;
+	}
+
+	return lowerLimit;
+}
+
+// Binary search that narrows [lowerLimit, upperLimit] with the L1 and L2
+// resident sample tables before searching the UEG, like the FPGA
+// BSCache. Returns the same index as grid_search.
+long grid_search_bscache( long n, double quarry, GridPoint * A, LookupTables * lt )
+{
+	// Sample positions -1 and m stand for the ends of each table
+	long lo = -1;
+	long hi = lt->bsc_l1_n;
+	long mid;
+	while( hi - lo > 1 )
+	{
+		mid = lo + ( hi - lo ) / 2;
+		if( lt->bsc_l1_energy[mid] > quarry )
+			hi = mid;
+		else
+			lo = mid;
+	}
+
+	lo = ( lo < 0 ) ? -1 : lt->bsc_l1_index[lo];
+	hi = ( hi >= lt->bsc_l1_n ) ? lt->bsc_l2_n : lt->bsc_l1_index[hi];
+	while( hi - lo > 1 )
+	{
+		mid = lo + ( hi - lo ) / 2;
+		if( lt->bsc_l2_energy[mid] > quarry )
+			hi = mid;
+		else
+			lo = mid;
+	}
+
+	long lowerLimit = ( lo < 0 ) ? 0 : lt->bsc_l2_index[lo];
+	long upperLimit = ( hi >= lt->bsc_l2_n ) ? n-1 : lt->bsc_l2_index[hi];
+	long examinationPoint;
+	long length = upperLimit - lowerLimit;
+
+	while( length > 1 )
+	{
+		examinationPoint = lowerLimit + ( length / 2 );
+
+		if( A[examinationPoint].energy > quarry )
+			upperLimit = examinationPoint;
+		else
+			lowerLimit = examinationPoint;
+
+		length = upperLimit - lowerLimit;
+	}
+
+	return lowerLimit;
+}
+
+// Branch-free search on the Eytzinger ordered unionized grid energies.
+// Returns the same index as grid_search. The loop descends the implicit
+// tree with a conditional move, ending at the first energy greater than
+// quarry. The 8 descendants of node k three levels down (8k .. 8k+7)
+// share a cache line, which is prefetched while the next levels are
+// being resolved.
+long grid_search_eytzinger( long n, double quarry, double * eyt_energy, int * eyt_index )
+{
+	long k = 1;
+	while( k <= n )
+	{
+		__builtin_prefetch( &eyt_energy[8 * k] );
+		k = 2 * k + (eyt_energy[k] <= quarry);
+	}
+
+	// Strip the trailing right turns (and the final left turn) to get
+	// the node of the first energy greater than quarry, 0 if none is
+	k >>= __builtin_ffsl( ~k );
+
+	long upper = eyt_index[k];
+	if( upper > n - 1 )
+		upper = n - 1;
+	if( upper < 1 )
+		upper = 1;
+	return upper - 1;
+}
+
+// Position of the first of a k-ary tree node's KARY_B energies that is
+// greater than quarry (KARY_B if there is none)
+static long kary_node_search_scalar( double * keys, double quarry )
+{
+	long i = 0;
+	for( long j = 0; j < KARY_B; j++ )
+		i += (keys[j] <= quarry);
+	return i;
+}
+
+__attribute__((target("avx2")))
+static long kary_node_search_avx2( double * keys, double quarry )
+{
+	__m256d q = _mm256_set1_pd( quarry );
+	__m256d lo = _mm256_load_pd( keys );
+	__m256d hi = _mm256_load_pd( keys + 4 );
+	int mask = _mm256_movemask_pd( _mm256_cmp_pd( lo, q, _CMP_GT_OQ ) )
+	         | _mm256_movemask_pd( _mm256_cmp_pd( hi, q, _CMP_GT_OQ ) ) << 4;
+	return __builtin_ctz( mask | (1 << KARY_B) );
+}
+
+__attribute__((target("avx512f")))
+static long kary_node_search_avx512( double * keys, double quarry )
+{
+	__m512d q = _mm512_set1_pd( quarry );
+	__m512d k = _mm512_load_pd( keys );
+	int mask = _mm512_cmp_pd_mask( k, q, _CMP_GT_OQ );
+	return __builtin_ctz( mask | (1 << KARY_B) );
+}
+
+// Picks the widest node search the CPU supports
+void select_kary_node_search( LookupTables * lt )
+{
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx512f") )
+	{
+		lt->kary_node_search = kary_node_search_avx512;
+		printf("Using AVX-512 k-ary search\n");
+	}
+	else if( __builtin_cpu_supports("avx2") )
+	{
+		lt->kary_node_search = kary_node_search_avx2;
+		printf("Using AVX2 k-ary search\n");
+	}
+	else
+	{
+		lt->kary_node_search = kary_node_search_scalar;
+		printf("Using scalar k-ary search\n");
+	}
+}
+
+// Search of the k-ary tree of unionized grid energies. Returns the same
+// index as grid_search. Each step compares quarry against one node's
+// KARY_B energies at once, and the comparison mask picks the child.
+long grid_search_kary( long n, double quarry, LookupTables * lt )
+{
+	long upper = n;
+	long k = 0;
+	while( k < lt->kary_nodes )
+	{
+		long i = lt->kary_node_search( &lt->kary_energy[k * KARY_B], quarry );
+		if( i < KARY_B )
+			upper = lt->kary_index[k * KARY_B + i];
+		k = k * (KARY_B + 1) + 1 + i;
+	}
+
+	if( upper > n - 1 )
+		upper = n - 1;
+	if( upper < 1 )
+		upper = 1;
+	return upper - 1;
+}
+
 // binary search for energy on nuclide energy grid
-long grid_search_nuclide( long n, double quarry, NuclideGridPoint * A, long low, long high)
+template <typename point_t>
+long grid_search_nuclide( long n, double quarry, const point_t * A, long low, long high)
 {
 	long lowerLimit = low;
 	long upperLimit = high;
@@ -205,3 +1100,6 @@ long grid_search_nuclide( long n, double quarry, NuclideGridPoint * A, long low,
 	
 	return lowerLimit;
 }
+
+template long grid_search_nuclide<NuclideGridPoint>( long, double, const NuclideGridPoint *, long, long );
+template long grid_search_nuclide<FloatGridPoint>( long, double, const FloatGridPoint *, long, long );
@@ -1,35 +1,173 @@
 #include "XSbench_header.h"
+#include "AOCLUtils/aocl_utils.h"
+using namespace aocl_utils;
 
 #ifdef MPI
 #include<mpi.h>
 #endif
 
+// Number of hash bins whose nuclide indices are swept per pass of
+// sweep_bin_edges before being transposed into the hash grid
+#define HASH_SWEEP_BINS 4096
+
+// Macro table rows filled per task of generate_macro_tables
+#define MACRO_TABLE_CHUNK 4096
+
+// For every bin edge energy, finds per nuclide the index that
+// grid_search_nuclide returns for that energy, plus "shift" (clamped to
+// the last gridpoint), and stores it in
+// table[b * row_stride + i * col_stride].
+// The edge energies increase monotonically, so instead of one binary
+// search per (edge, nuclide) each nuclide's index is found with a single
+// forward sweep over the edges. Threads sweep different nuclides, which
+// would scatter their writes across every row of the table, so the edges
+// are processed HASH_SWEEP_BINS at a time: each thread writes its
+// nuclides' indices to a contiguous column of a scratch buffer, and the
+// buffer is then transposed into the rows of the table in parallel.
+static void sweep_bin_edges( NuclideGridPoint ** nuclide_grids,
+                             long n_isotopes, long n_gridpoints,
+                             double * edge, long n_edges, int * table,
+                             long row_stride, long col_stride, int shift )
+{
+	// Current index of each nuclide, carried from one pass to the next
+	long * idx = (long *) calloc( n_isotopes, sizeof(long) );
+	int * sweep = (int *) alignedMalloc( n_isotopes * HASH_SWEEP_BINS * sizeof(int) );
+
+	for( long e0 = 0; e0 < n_edges; e0 += HASH_SWEEP_BINS )
+	{
+		long n_bins = n_edges - e0;
+		if( n_bins > HASH_SWEEP_BINS )
+			n_bins = HASH_SWEEP_BINS;
+
+		// Sweep each nuclide over this pass's edges
+		#pragma omp parallel for schedule(static)
+		for( long i = 0; i < n_isotopes; i++ )
+		{
+			NuclideGridPoint * A = nuclide_grids[i];
+			int * col = &sweep[i * HASH_SWEEP_BINS];
+			long low = idx[i];
+			for( long b = 0; b < n_bins; b++ )
+			{
+				double energy = edge[e0 + b];
+				while( low < n_gridpoints - 2 && A[low+1].energy <= energy )
+					low++;
+				col[b] = low;
+			}
+			idx[i] = low;
+		}
+
+		// Transpose the columns into the table rows
+		#pragma omp parallel for schedule(static)
+		for( long b = 0; b < n_bins; b++ )
+		{
+			int * row = &table[(e0 + b) * row_stride];
+			for( long i = 0; i < n_isotopes; i++ )
+			{
+				int ptr = sweep[i * HASH_SWEEP_BINS + b] + shift;
+				if( ptr > n_gridpoints - 1 )
+					ptr = n_gridpoints - 1;
+				row[i * col_stride] = ptr;
+			}
+		}
+	}
+
+	free(idx);
+	alignedFree(sweep);
+}
+
+// Builds the hash grid. For every bin, xs_ptrs holds, per nuclide, the
+// index that grid_search_nuclide returns for the bin's lower energy.
 GridPoint * generate_hash_table( NuclideGridPoint ** nuclide_grids,
                           long n_isotopes, long n_gridpoints, long hash_bins )
 {
 	printf("Generating Hash Grid...\n");
 
 	GridPoint * energy_grid = (GridPoint *)malloc( hash_bins * sizeof( GridPoint ) );
-	int * full = (int *) malloc( n_isotopes * hash_bins * sizeof(int) );
+	int * full = (int *) alignedMalloc( n_isotopes * hash_bins * sizeof(int) );
+	double * edge = (double *) malloc( hash_bins * sizeof(double) );
+	if( energy_grid == NULL || full == NULL || edge == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	double du = 1.0 / hash_bins;
 
 	for( long i = 0; i < hash_bins; i++ )
+	{
 		energy_grid[i].xs_ptrs = &full[n_isotopes * i];
+		energy_grid[i].energy = i * du;
+		edge[i] = i * du;
+	}
 
-	double du = 1.0 / hash_bins;
+	sweep_bin_edges( nuclide_grids, n_isotopes, n_gridpoints, edge, hash_bins,
+	                 full, n_isotopes, 1, 0 );
+
+	free(edge);
 
-	// For each energy level in the hash table
-	#pragma omp parallel for
-	for( long e = 0; e < hash_bins; e++ )
+	return energy_grid;
+}
+
+// Builds the logarithmic hash grid. Bins are spaced evenly in log(energy)
+// between the lowest non-zero and the highest nuclide grid energy, with
+// all lower energies falling into the first bin. Nuclide grid points are
+// dense at low energies in real data, so log spacing keeps the number of
+// points per bin (and the search window) small everywhere. For every bin,
+// xs_ptrs holds an interleaved (low, high) pair per nuclide that brackets
+// the bin's energy range, so both bounds come from the same cache line.
+// The log-space origin and bin width are stored in lt for the lookup.
+GridPoint * generate_loghash_table( NuclideGridPoint ** nuclide_grids,
+                          long n_isotopes, long n_gridpoints, long hash_bins,
+                          LookupTables * lt )
+{
+	printf("Generating Logarithmic Hash Grid...\n");
+
+	GridPoint * energy_grid = (GridPoint *)malloc( hash_bins * sizeof( GridPoint ) );
+	int * full = (int *) alignedMalloc( 2 * n_isotopes * hash_bins * sizeof(int) );
+	double * edge = (double *) malloc( (hash_bins + 1) * sizeof(double) );
+	if( energy_grid == NULL || full == NULL || edge == NULL )
 	{
-		double energy = e * du;
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
 
-		// We need to determine the bounding energy levels for all isotopes
-		for( long i = 0; i < n_isotopes; i++ )
-		{
-			energy_grid[e].xs_ptrs[i] = grid_search_nuclide( n_gridpoints, energy, nuclide_grids[i], 0, n_gridpoints-1);
-		}
+	double e_min = 1.0;
+	double e_max = 0.0;
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		long j = 0;
+		while( j < n_gridpoints - 1 && nuclide_grids[i][j].energy <= 0 )
+			j++;
+		if( nuclide_grids[i][j].energy > 0 && nuclide_grids[i][j].energy < e_min )
+			e_min = nuclide_grids[i][j].energy;
+		if( nuclide_grids[i][n_gridpoints-1].energy > e_max )
+			e_max = nuclide_grids[i][n_gridpoints-1].energy;
+	}
+	if( e_max <= e_min )
+		e_max = 2 * e_min;
+
+	lt->loghash_log_min = log(e_min);
+	double dlog = (log(e_max) - lt->loghash_log_min) / hash_bins;
+	lt->loghash_inv_dlog = 1.0 / dlog;
+
+	for( long i = 0; i <= hash_bins; i++ )
+		edge[i] = exp( lt->loghash_log_min + i * dlog );
+
+	for( long i = 0; i < hash_bins; i++ )
+	{
+		energy_grid[i].xs_ptrs = &full[2 * n_isotopes * i];
+		energy_grid[i].energy = edge[i];
 	}
 
+	// Low bounds from the lower bin edges, high bounds one past the
+	// index of the upper bin edges
+	sweep_bin_edges( nuclide_grids, n_isotopes, n_gridpoints, edge, hash_bins,
+	                 full, 2 * n_isotopes, 2, 0 );
+	sweep_bin_edges( nuclide_grids, n_isotopes, n_gridpoints, edge + 1, hash_bins,
+	                 full + 1, 2 * n_isotopes, 2, 1 );
+
+	free(edge);
+
 	return energy_grid;
 }
 
@@ -49,6 +187,25 @@ void generate_grids( NuclideGridPoint ** nuclide_grids,
 			nuclide_grids[i][j].nu_fission_xs=((double)rand()/(double)RAND_MAX);
 		}
 }
+
+// Parallel version of generate_grids using the counter based RNG. Every
+// value is keyed on its nuclide, gridpoint and field, so the grids are
+// bit-identical for any number of threads.
+void generate_grids_counter( NuclideGridPoint ** nuclide_grids,
+                     long n_isotopes, long n_gridpoints, unsigned long seed ) {
+	#pragma omp parallel for schedule(static)
+	for( long i = 0; i < n_isotopes; i++ )
+		for( long j = 0; j < n_gridpoints; j++ )
+		{
+			unsigned long c = (i * n_gridpoints + j) * 6;
+			nuclide_grids[i][j].energy       = rn_counter(seed, c);
+			nuclide_grids[i][j].total_xs     = rn_counter(seed, c + 1);
+			nuclide_grids[i][j].elastic_xs   = rn_counter(seed, c + 2);
+			nuclide_grids[i][j].absorbtion_xs= rn_counter(seed, c + 3);
+			nuclide_grids[i][j].fission_xs   = rn_counter(seed, c + 4);
+			nuclide_grids[i][j].nu_fission_xs= rn_counter(seed, c + 5);
+		}
+}
 /*
 // Verification version of this function (tighter control over RNG)
 void generate_grids_v( NuclideGridPoint ** nuclide_grids,
@@ -65,16 +222,69 @@ void generate_grids_v( NuclideGridPoint ** nuclide_grids,
 		}
 }
 */
+// Sorts a single nuclide grid by energy with an LSD radix sort. The
+// energies are non-negative, so their IEEE-754 bit patterns sort in the
+// same order as their values. (bit pattern, index) pairs are sorted one
+// byte at a time, skipping bytes that are the same for every point, and
+// the 48 byte gridpoints are then permuted once. The sort is stable, so
+// points with equal energies keep their original order.
+static void radix_sort_nuclide_grid( NuclideGridPoint * grid, long n )
+{
+	unsigned long * key     = (unsigned long *) malloc( n * sizeof(unsigned long) );
+	unsigned long * key_tmp = (unsigned long *) malloc( n * sizeof(unsigned long) );
+	int * idx     = (int *) malloc( n * sizeof(int) );
+	int * idx_tmp = (int *) malloc( n * sizeof(int) );
+
+	for( long j = 0; j < n; j++ )
+	{
+		memcpy( &key[j], &grid[j].energy, sizeof(double) );
+		idx[j] = j;
+	}
+
+	for( int shift = 0; shift < 64; shift += 8 )
+	{
+		long count[257] = {0};
+		for( long j = 0; j < n; j++ )
+			count[((key[j] >> shift) & 0xFF) + 1]++;
+
+		// All points share this byte
+		if( count[((key[0] >> shift) & 0xFF) + 1] == n )
+			continue;
+
+		for( int d = 0; d < 256; d++ )
+			count[d+1] += count[d];
+
+		for( long j = 0; j < n; j++ )
+		{
+			long dst = count[(key[j] >> shift) & 0xFF]++;
+			key_tmp[dst] = key[j];
+			idx_tmp[dst] = idx[j];
+		}
+
+		unsigned long * k = key; key = key_tmp; key_tmp = k;
+		int * t = idx; idx = idx_tmp; idx_tmp = t;
+	}
+
+	NuclideGridPoint * sorted = (NuclideGridPoint *) alignedMalloc( n * sizeof(NuclideGridPoint) );
+	for( long j = 0; j < n; j++ )
+		sorted[j] = grid[idx[j]];
+	memcpy( grid, sorted, n * sizeof(NuclideGridPoint) );
+
+	alignedFree(sorted);
+	free(key);
+	free(key_tmp);
+	free(idx);
+	free(idx_tmp);
+}
+
 // Sorts the nuclide grids by energy (lowest -> highest)
+// Nuclides are sorted concurrently, each with a radix sort.
 void sort_nuclide_grids( NuclideGridPoint ** nuclide_grids, long n_isotopes,
                          long n_gridpoints )
 {
-	int (*cmp) (const void *, const void *);
-	cmp = NGP_compare;
-	
+	#pragma omp parallel for schedule(dynamic,1)
 	for( long i = 0; i < n_isotopes; i++ )
-		qsort( nuclide_grids[i], n_gridpoints, sizeof(NuclideGridPoint),
-		       cmp );
+		radix_sort_nuclide_grid( nuclide_grids[i], n_gridpoints );
 	
 	// error debug check
 	/*
@@ -87,10 +297,155 @@ void sort_nuclide_grids( NuclideGridPoint ** nuclide_grids, long n_isotopes,
 	*/
 }
 
-// Allocates unionized energy grid, and assigns union of energy levels
-// from nuclide grids to it.
+// Number of points in a sorted nuclide grid with energy < e (lower bound)
+// or energy <= e (upper bound)
+static long nuclide_lower_bound( NuclideGridPoint * A, long n, double e )
+{
+	long lo = 0;
+	long hi = n;
+	while( lo < hi )
+	{
+		long mid = lo + (hi - lo) / 2;
+		if( A[mid].energy < e )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static long nuclide_upper_bound( NuclideGridPoint * A, long n, double e )
+{
+	long lo = 0;
+	long hi = n;
+	while( lo < hi )
+	{
+		long mid = lo + (hi - lo) / 2;
+		if( A[mid].energy <= e )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Finds, for the given rank in the unionized grid, the offset into each
+// nuclide grid at which the merge must be split. The split energy is the
+// smallest energy that has at least "rank" points at or below it. As the
+// energies are all non-negative, their IEEE-754 bit patterns sort in the
+// same order as their values, so the split energy is found by bisecting
+// on the bit pattern. Points equal to the split energy all go to the
+// upper range, so ranges are only approximately "rank" sized when there
+// are duplicate energies.
+static void find_merge_split( NuclideGridPoint ** nuclide_grids,
+                              long n_isotopes, long n_gridpoints,
+                              long rank, long * split )
+{
+	double e_max = 0;
+	for( long i = 0; i < n_isotopes; i++ )
+		if( nuclide_grids[i][n_gridpoints-1].energy > e_max )
+			e_max = nuclide_grids[i][n_gridpoints-1].energy;
+
+	unsigned long lo = 0;
+	unsigned long hi;
+	memcpy( &hi, &e_max, sizeof(double) );
+
+	while( lo < hi )
+	{
+		unsigned long mid = lo + (hi - lo) / 2;
+		double e;
+		memcpy( &e, &mid, sizeof(double) );
+
+		long count = 0;
+		for( long i = 0; i < n_isotopes; i++ )
+			count += nuclide_upper_bound( nuclide_grids[i], n_gridpoints, e );
+
+		if( count >= rank )
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	double e_split;
+	memcpy( &e_split, &lo, sizeof(double) );
+	for( long i = 0; i < n_isotopes; i++ )
+		split[i] = nuclide_lower_bound( nuclide_grids[i], n_gridpoints, e_split );
+}
+
+typedef struct{
+	double energy;
+	long nuc;
+} MergeHead;
+
+// Restores the min-heap property from position k downwards
+static void merge_sift_down( MergeHead * heap, long size, long k )
+{
+	MergeHead top = heap[k];
+	while( 2*k + 1 < size )
+	{
+		long child = 2*k + 1;
+		if( child + 1 < size && heap[child+1].energy < heap[child].energy )
+			child++;
+		if( heap[child].energy >= top.energy )
+			break;
+		heap[k] = heap[child];
+		k = child;
+	}
+	heap[k] = top;
+}
+
+// Merges nuclide_grids[i][start[i] .. end[i]) for all nuclides into the
+// unionized energy grid, starting at unionized grid index "out".
+static void merge_nuclide_grids( NuclideGridPoint ** nuclide_grids,
+                                 long n_isotopes, long * start, long * end,
+                                 GridPoint * energy_grid, long out )
+{
+	MergeHead * heap = (MergeHead *) malloc( n_isotopes * sizeof(MergeHead) );
+	long * pos = (long *) malloc( n_isotopes * sizeof(long) );
+	long size = 0;
+
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		pos[i] = start[i];
+		if( pos[i] < end[i] )
+		{
+			heap[size].energy = nuclide_grids[i][pos[i]].energy;
+			heap[size].nuc = i;
+			size++;
+		}
+	}
+
+	for( long k = size / 2 - 1; k >= 0; k-- )
+		merge_sift_down( heap, size, k );
+
+	while( size > 0 )
+	{
+		long i = heap[0].nuc;
+		energy_grid[out++].energy = heap[0].energy;
+
+		if( ++pos[i] < end[i] )
+			heap[0].energy = nuclide_grids[i][pos[i]].energy;
+		else
+			heap[0] = heap[--size];
+
+		merge_sift_down( heap, size, 0 );
+	}
+
+	free(heap);
+	free(pos);
+}
+
+// Allocates unionized energy grid on the given pages, and assigns union
+// of energy levels from nuclide grids to it. The int xs_ptrs arrays are
+// only allocated for the INDEX_INT encoding, the compact encodings are
+// allocated when the index is built.
+// The nuclide grids are already sorted, so rather than copying them all
+// and sorting the copy, the unionized grid is built with a parallel k-way
+// merge. The unionized grid is cut into one range per thread, the offsets
+// of each range into every nuclide grid are found by find_merge_split,
+// and each thread then merges its range directly into energy_grid.
 GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
-                                  NuclideGridPoint ** nuclide_grids) {
+                                  NuclideGridPoint ** nuclide_grids, int index_type, int pages ) {
 	int mype = 0;
 
 	#ifdef MPI
@@ -100,32 +455,49 @@ GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
 	if( mype == 0 ) printf("Generating Unionized Energy Grid...\n");
 	
 	long n_unionized_grid_points = n_isotopes*n_gridpoints;
-	int (*cmp) (const void *, const void *);
-	cmp = NGP_compare;
-	
-	GridPoint * energy_grid = (GridPoint *)malloc( n_unionized_grid_points
-	                                               * sizeof( GridPoint ) );
-	if( mype == 0 ) printf("Copying and Sorting all nuclide grids...\n");
-	
-	NuclideGridPoint ** n_grid_sorted = gpmatrix( n_isotopes, n_gridpoints );
-	
-	  	
-	memcpy( n_grid_sorted[0], nuclide_grids[0], n_isotopes*n_gridpoints*
-	                                      sizeof( NuclideGridPoint ) );
-	
-	qsort( &n_grid_sorted[0][0], n_unionized_grid_points,
-	       sizeof(NuclideGridPoint), cmp);
-	
-	if( mype == 0 ) printf("Assigning energies to unionized grid...\n");
-	
-	for( long i = 0; i < n_unionized_grid_points; i++ )
-		energy_grid[i].energy = n_grid_sorted[0][i].energy;
 	
+	GridPoint * energy_grid = (GridPoint *)huge_malloc( n_unionized_grid_points
+	                                                    * sizeof( GridPoint ), pages );
+	if( mype == 0 ) printf("Merging all nuclide grids...\n");
+
+	long n_ranges = omp_get_max_threads();
+	long * split = (long *) malloc( (n_ranges + 1) * n_isotopes * sizeof(long) );
 
-	gpmatrix_free(n_grid_sorted);
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		split[i] = 0;
+		split[n_ranges * n_isotopes + i] = n_gridpoints;
+	}
+
+	#pragma omp parallel for schedule(dynamic,1)
+	for( long r = 1; r < n_ranges; r++ )
+		find_merge_split( nuclide_grids, n_isotopes, n_gridpoints,
+		                  r * n_unionized_grid_points / n_ranges,
+		                  &split[r * n_isotopes] );
+
+	#pragma omp parallel for schedule(dynamic,1)
+	for( long r = 0; r < n_ranges; r++ )
+	{
+		long * start = &split[r * n_isotopes];
+		long * end = &split[(r+1) * n_isotopes];
+		long out = 0;
+		for( long i = 0; i < n_isotopes; i++ )
+			out += start[i];
+		merge_nuclide_grids( nuclide_grids, n_isotopes, start, end,
+		                     energy_grid, out );
+	}
+
+	free(split);
+
+	if( index_type != INDEX_INT )
+	{
+		for( long i = 0; i < n_unionized_grid_points; i++ )
+			energy_grid[i].xs_ptrs = NULL;
+		return energy_grid;
+	}
 	
-	int * full = (int *) malloc( n_isotopes * n_unionized_grid_points
-	                             * sizeof(int) );
+	int * full = (int *) huge_malloc( n_isotopes * n_unionized_grid_points
+	                                  * sizeof(int), pages );
 	if( full == NULL )
 	{
 		fprintf(stderr,"ERROR - Out Of Memory!\n");
@@ -144,6 +516,591 @@ GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
 	return energy_grid;
 }
 
+// Builds the Eytzinger (BFS) ordered copy of the unionized grid energies
+// used by grid_search_eytzinger. Node k has children 2k and 2k+1, so the
+// in-order traversal of the tree visits the energies in sorted order.
+void generate_eytzinger_grid( GridPoint * energy_grid, long n, LookupTables * lt )
+{
+	printf("Generating Eytzinger Search Tree...\n");
+
+	lt->eyt_energy = (double *) alignedMalloc( (n + 1) * sizeof(double) );
+	lt->eyt_index = (int *) alignedMalloc( (n + 1) * sizeof(int) );
+	if( lt->eyt_energy == NULL || lt->eyt_index == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	// Iterative in-order traversal
+	long * stack = (long *) malloc( 64 * sizeof(long) );
+	long top = 0;
+	long k = 1;
+	long i = 0;
+	while( top > 0 || k <= n )
+	{
+		if( k <= n )
+		{
+			stack[top++] = k;
+			k = 2 * k;
+		}
+		else
+		{
+			k = stack[--top];
+			lt->eyt_energy[k] = energy_grid[i].energy;
+			lt->eyt_index[k] = i;
+			i++;
+			k = 2 * k + 1;
+		}
+	}
+	free(stack);
+
+	lt->eyt_energy[0] = 0;
+	lt->eyt_index[0] = n;
+}
+
+// Fills node k of the k-ary search tree and its subtrees in order.
+// Node k's children are k * (KARY_B + 1) + 1 + i, for i in 0..KARY_B.
+static void fill_kary_node( GridPoint * energy_grid, long n, LookupTables * lt,
+                            long k, long * next )
+{
+	if( k >= lt->kary_nodes )
+		return;
+
+	for( long i = 0; i < KARY_B; i++ )
+	{
+		fill_kary_node( energy_grid, n, lt, k * (KARY_B + 1) + 1 + i, next );
+		if( *next < n )
+		{
+			lt->kary_energy[k * KARY_B + i] = energy_grid[*next].energy;
+			lt->kary_index[k * KARY_B + i] = *next;
+			(*next)++;
+		}
+		else
+		{
+			// Padding, greater than any energy
+			lt->kary_energy[k * KARY_B + i] = HUGE_VAL;
+			lt->kary_index[k * KARY_B + i] = n;
+		}
+	}
+	fill_kary_node( energy_grid, n, lt, k * (KARY_B + 1) + 1 + KARY_B, next );
+}
+
+// Builds the k-ary search tree used by grid_search_kary. Each node holds
+// KARY_B sorted energies in one cache line and has KARY_B + 1 children,
+// so a search visits about a third as many levels as a binary search.
+void generate_kary_grid( GridPoint * energy_grid, long n, LookupTables * lt )
+{
+	printf("Generating K-ary Search Tree...\n");
+
+	lt->kary_nodes = (n + KARY_B - 1) / KARY_B;
+	lt->kary_energy = (double *) alignedMalloc( lt->kary_nodes * KARY_B * sizeof(double) );
+	lt->kary_index = (int *) alignedMalloc( lt->kary_nodes * KARY_B * sizeof(int) );
+	if( lt->kary_energy == NULL || lt->kary_index == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	long next = 0;
+	fill_kary_node( energy_grid, n, lt, 0, &next );
+
+	select_kary_node_search( lt );
+}
+
+// Largest 2^k - 1 table entries of entry_size bytes that fit in half of
+// a cache of cache_size bytes, capped at max_entries
+static long bscache_entries( long cache_size, long entry_size, long max_entries )
+{
+	long n = 1;
+	while( (2 * n + 1) * entry_size <= cache_size / 2 && 2 * n + 1 <= max_entries )
+		n = 2 * n + 1;
+	return n;
+}
+
+// Builds the host version of the FPGA BSCache: a table of evenly spaced
+// UEG samples sized to stay in L2, and a smaller table of evenly spaced
+// samples of that one sized to stay in L1. grid_search_bscache walks
+// both before touching the DRAM resident energy_grid.
+void generate_bscache( GridPoint * energy_grid, long n, LookupTables * lt )
+{
+	printf("Generating Binary Search Cache...\n");
+
+	long l1_size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+	long l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if( l1_size <= 0 )
+		l1_size = 32 * 1024;
+	if( l2_size <= 0 )
+		l2_size = 256 * 1024;
+
+	long entry_size = sizeof(double) + sizeof(int);
+	lt->bsc_l2_n = bscache_entries( l2_size, entry_size, n / 4 );
+	lt->bsc_l1_n = bscache_entries( l1_size, entry_size, lt->bsc_l2_n / 4 );
+
+	lt->bsc_l1_energy = (double *) alignedMalloc( lt->bsc_l1_n * sizeof(double) );
+	lt->bsc_l1_index = (int *) alignedMalloc( lt->bsc_l1_n * sizeof(int) );
+	lt->bsc_l2_energy = (double *) alignedMalloc( lt->bsc_l2_n * sizeof(double) );
+	lt->bsc_l2_index = (int *) alignedMalloc( lt->bsc_l2_n * sizeof(int) );
+	if( lt->bsc_l1_energy == NULL || lt->bsc_l1_index == NULL ||
+	    lt->bsc_l2_energy == NULL || lt->bsc_l2_index == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	// Same sampling as the FPGA cache: entry s is at (s+1) * n / (m+1)
+	for( long s = 0; s < lt->bsc_l2_n; s++ )
+	{
+		long i = (s + 1) * n / (lt->bsc_l2_n + 1);
+		if( i > n - 2 )
+			i = n - 2; // only for tiny grids, keeps results equal to grid_search
+		lt->bsc_l2_energy[s] = energy_grid[i].energy;
+		lt->bsc_l2_index[s] = i;
+	}
+	for( long s = 0; s < lt->bsc_l1_n; s++ )
+	{
+		long i = (s + 1) * lt->bsc_l2_n / (lt->bsc_l1_n + 1);
+		lt->bsc_l1_energy[s] = lt->bsc_l2_energy[i];
+		lt->bsc_l1_index[s] = i;
+	}
+
+	printf("Search cache entries: %ld (L1), %ld (L2)\n", lt->bsc_l1_n, lt->bsc_l2_n);
+}
+
+// Copies the nuclide grids with the XS in single precision, for the mixed
+// precision lookups
+void generate_float_grid( NuclideGridPoint ** nuclide_grids, long n_isotopes,
+                          long n_gridpoints, LookupTables * lt )
+{
+	printf("Generating Mixed Precision Nuclide Grids...\n");
+
+	lt->float_grid = (FloatGridPoint *) alignedMalloc( n_isotopes * n_gridpoints
+	                                                   * sizeof(FloatGridPoint) );
+	if( lt->float_grid == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	#pragma omp parallel for schedule(static)
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		for( long j = 0; j < n_gridpoints; j++ )
+		{
+			NuclideGridPoint * point = &nuclide_grids[i][j];
+			FloatGridPoint * f = &lt->float_grid[i * n_gridpoints + j];
+			f->energy        = point->energy;
+			f->total_xs      = point->total_xs;
+			f->elastic_xs    = point->elastic_xs;
+			f->absorbtion_xs = point->absorbtion_xs;
+			f->fission_xs    = point->fission_xs;
+			f->nu_fission_xs = point->nu_fission_xs;
+		}
+	}
+}
+
+// Builds the slope grid: each nuclide grid point along with the reciprocal
+// of the energy step and the XS differences up to the next point, so a
+// lookup interpolates from a single record without a division
+void generate_slope_grid( NuclideGridPoint ** nuclide_grids, long n_isotopes,
+                          long n_gridpoints, LookupTables * lt )
+{
+	printf("Generating Slope Grids...\n");
+
+	lt->slope_grid = (SlopeGridPoint *) alignedMalloc( n_isotopes * n_gridpoints
+	                                                   * sizeof(SlopeGridPoint) );
+	if( lt->slope_grid == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	#pragma omp parallel for schedule(static)
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		for( long j = 0; j < n_gridpoints; j++ )
+		{
+			NuclideGridPoint * low = &nuclide_grids[i][j];
+			// The last point is never interpolated from
+			NuclideGridPoint * high = ( j < n_gridpoints - 1 ) ? low + 1 : low;
+			SlopeGridPoint * s = &lt->slope_grid[i * n_gridpoints + j];
+
+			double de = high->energy - low->energy;
+			double inv_de = ( de > 0 ) ? 1.0 / de : 0;
+			s->energy   = low->energy;
+			s->xs[0]    = low->total_xs;
+			s->xs[1]    = low->elastic_xs;
+			s->xs[2]    = low->absorbtion_xs;
+			s->xs[3]    = low->fission_xs;
+			s->xs[4]    = low->nu_fission_xs;
+			s->slope[0] = (high->total_xs - low->total_xs) * inv_de;
+			s->slope[1] = (high->elastic_xs - low->elastic_xs) * inv_de;
+			s->slope[2] = (high->absorbtion_xs - low->absorbtion_xs) * inv_de;
+			s->slope[3] = (high->fission_xs - low->fission_xs) * inv_de;
+			s->slope[4] = (high->nu_fission_xs - low->nu_fission_xs) * inv_de;
+		}
+	}
+}
+
+// Fills the macro XS of rows [start, end) of the macro table t of a
+// material with nuclides nucs[0 .. n_nucs-1], at concentrations conc.
+// Each nuclide is interpolated from the same gridpoints calculate_micro_xs
+// uses, found by a binary search at "start" and swept from there.
+static void fill_macro_table_range( NuclideGridPoint ** nuclide_grids, long n_gridpoints,
+                                    int n_nucs, int * nucs, double * conc,
+                                    MacroTable * t, long start, long end )
+{
+	long * idx = (long *) malloc( n_nucs * sizeof(long) );
+	for( int j = 0; j < n_nucs; j++ )
+	{
+		NuclideGridPoint * grid = nuclide_grids[nucs[j]];
+		idx[j] = grid_search_nuclide( n_gridpoints, t->energy[start],
+		                              grid, 0, n_gridpoints-1 );
+		while( idx[j] > 0 && grid[idx[j]].energy >= t->energy[start] )
+			idx[j]--;
+	}
+
+	for( long i = start; i < end; i++ )
+	{
+		double e = t->energy[i];
+		double * xs = &t->xs[5 * i];
+		// The first row of a repeated energy holds the limit from below
+		int below = ( i + 1 < t->n && t->energy[i+1] == e );
+		for( int k = 0; k < 5; k++ )
+			xs[k] = 0;
+
+		for( int j = 0; j < n_nucs; j++ )
+		{
+			NuclideGridPoint * grid = nuclide_grids[nucs[j]];
+			while( idx[j] < n_gridpoints - 2 && ( grid[idx[j]+1].energy < e ||
+			       ( !below && grid[idx[j]+1].energy == e ) ) )
+				idx[j]++;
+
+			NuclideGridPoint * low = &grid[idx[j]];
+			NuclideGridPoint * high = low + 1;
+			double f = (high->energy - e) / (high->energy - low->energy);
+			xs[0] += (high->total_xs - f * (high->total_xs - low->total_xs)) * conc[j];
+			xs[1] += (high->elastic_xs - f * (high->elastic_xs - low->elastic_xs)) * conc[j];
+			xs[2] += (high->absorbtion_xs - f * (high->absorbtion_xs - low->absorbtion_xs)) * conc[j];
+			xs[3] += (high->fission_xs - f * (high->fission_xs - low->fission_xs)) * conc[j];
+			xs[4] += (high->nu_fission_xs - f * (high->nu_fission_xs - low->nu_fission_xs)) * conc[j];
+		}
+	}
+
+	free(idx);
+}
+
+// Builds one table per material of its macroscopic XS, summed over its
+// nuclides at every energy of their grids. Between two of these energies
+// every nuclide's XS is linear, so interpolating the table gives the same
+// macro XS as summing the interpolated micro XS, up to rounding.
+void generate_macro_tables( NuclideGridPoint ** nuclide_grids, long n_gridpoints,
+                            int * num_nucs, int ** mats, double ** concs,
+                            LookupTables * lt )
+{
+	printf("Generating Material Macro XS Tables...\n");
+	double start_time = omp_get_wtime();
+
+	lt->macro_tables = (MacroTable *) malloc( N_MATERIALS * sizeof(MacroTable) );
+	size_t bytes = 0;
+	for( int m = 0; m < N_MATERIALS; m++ )
+	{
+		MacroTable * t = &lt->macro_tables[m];
+		int n_nucs = num_nucs[m];
+
+		// Union of the material's nuclide grids. A nuclide grid may repeat an
+		// energy where its XS steps, so each energy is kept at most twice to
+		// hold the values either side of the step.
+		NuclideGridPoint ** grids = (NuclideGridPoint **) malloc( n_nucs * sizeof(NuclideGridPoint *) );
+		long * start = (long *) malloc( n_nucs * sizeof(long) );
+		long * end = (long *) malloc( n_nucs * sizeof(long) );
+		GridPoint * merged = (GridPoint *) malloc( n_nucs * n_gridpoints * sizeof(GridPoint) );
+		t->energy = (double *) alignedMalloc( n_nucs * n_gridpoints * sizeof(double) );
+		if( grids == NULL || start == NULL || end == NULL || merged == NULL || t->energy == NULL )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+		for( int j = 0; j < n_nucs; j++ )
+		{
+			grids[j] = nuclide_grids[mats[m][j]];
+			start[j] = 0;
+			end[j] = n_gridpoints;
+		}
+		merge_nuclide_grids( grids, n_nucs, start, end, merged, 0 );
+
+		t->n = 0;
+		for( long i = 0; i < n_nucs * n_gridpoints; i++ )
+			if( t->n < 2 || merged[i].energy != t->energy[t->n - 2] )
+				t->energy[t->n++] = merged[i].energy;
+
+		free(grids);
+		free(start);
+		free(end);
+		free(merged);
+
+		t->xs = (double *) alignedMalloc( 5 * t->n * sizeof(double) );
+		if( t->xs == NULL )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+
+		#pragma omp parallel for schedule(dynamic,1)
+		for( long c = 0; c < t->n; c += MACRO_TABLE_CHUNK )
+			fill_macro_table_range( nuclide_grids, n_gridpoints, n_nucs, mats[m], concs[m],
+			                        t, c, ( c + MACRO_TABLE_CHUNK < t->n ) ? c + MACRO_TABLE_CHUNK : t->n );
+
+		bytes += t->n * 6 * sizeof(double);
+	}
+
+	printf("Macro tables: %.1f MB, built in %.3f s\n", bytes / 1048576.0,
+	       omp_get_wtime() - start_time);
+}
+
+// Places the nuclide grids and the energy grid on the NUMA nodes, once
+// they are complete. NUMA_INTERLEAVE spreads their pages over all nodes.
+// NUMA_REPLICATE gives every node a copy bound to it, read by the threads
+// running there, with node 0 keeping the original. The int xs_ptrs are
+// copied with the energy grid. Only these are replicated, so read_CLI
+// rejects replication with the options that build other lookup tables.
+// With simulated nodes the copies are made but not bound.
+void generate_numa_placement( Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids,
+                              LookupTables * lt )
+{
+	// Energy grid rows, and the ints of xs_ptrs each points to
+	long n_rows = 0;
+	long row_ints = 0;
+	if( in.grid_type == UNIONIZED )
+	{
+		n_rows = in.n_isotopes * in.n_gridpoints;
+		if( energy_grid[0].xs_ptrs != NULL )
+			row_ints = in.n_isotopes;
+	}
+	else if( in.grid_type == HASH )
+	{
+		n_rows = in.hash_bins;
+		row_ints = in.n_isotopes;
+	}
+	else if( in.grid_type == LOGHASH )
+	{
+		n_rows = in.hash_bins;
+		row_ints = 2 * in.n_isotopes;
+	}
+	size_t grid_bytes = in.n_isotopes * in.n_gridpoints * sizeof(NuclideGridPoint);
+	size_t row_bytes = n_rows * sizeof(GridPoint);
+	size_t index_bytes = n_rows * row_ints * sizeof(int);
+
+	if( in.numa == NUMA_INTERLEAVE )
+	{
+		printf("Interleaving XS data over %d NUMA nodes...\n", count_numa_nodes( 0 ));
+		place_numa_memory( nuclide_grids[0], grid_bytes, NUMA_ALL_NODES );
+		place_numa_memory( energy_grid, row_bytes, NUMA_ALL_NODES );
+		if( row_ints > 0 )
+			place_numa_memory( energy_grid[0].xs_ptrs, index_bytes, NUMA_ALL_NODES );
+		return;
+	}
+
+	lt->numa_nodes = count_numa_nodes( in.numa_nodes );
+	lt->numa_fake = ( in.numa_nodes > 0 );
+	printf("Replicating XS data on %d %sNUMA nodes...\n", lt->numa_nodes,
+	       lt->numa_fake ? "simulated " : "");
+	double start_time = omp_get_wtime();
+
+	lt->numa_energy_grid = (GridPoint **) malloc( lt->numa_nodes * sizeof(GridPoint *) );
+	lt->numa_nuclide_grids = (NuclideGridPoint ***) malloc( lt->numa_nodes * sizeof(NuclideGridPoint **) );
+	if( lt->numa_energy_grid == NULL || lt->numa_nuclide_grids == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+	lt->numa_energy_grid[0] = energy_grid;
+	lt->numa_nuclide_grids[0] = nuclide_grids;
+	if( !lt->numa_fake )
+	{
+		place_numa_memory( nuclide_grids[0], grid_bytes, 0 );
+		place_numa_memory( energy_grid, row_bytes, 0 );
+		if( row_ints > 0 )
+			place_numa_memory( energy_grid[0].xs_ptrs, index_bytes, 0 );
+	}
+
+	for( int node = 1; node < lt->numa_nodes; node++ )
+	{
+		NuclideGridPoint ** grids = gpmatrix( in.n_isotopes, in.n_gridpoints, in.pages );
+		GridPoint * rows = NULL;
+		int * index = NULL;
+		if( n_rows > 0 )
+			rows = (GridPoint *) huge_malloc( row_bytes, in.pages );
+		if( row_ints > 0 )
+			index = (int *) huge_malloc( index_bytes, in.pages );
+		if( grids == NULL || grids[0] == NULL || ( n_rows > 0 && rows == NULL ) ||
+		    ( row_ints > 0 && index == NULL ) )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+
+		// Bind before copying, so the pages are allocated on the node
+		if( !lt->numa_fake )
+		{
+			place_numa_memory( grids[0], grid_bytes, node );
+			place_numa_memory( rows, row_bytes, node );
+			place_numa_memory( index, index_bytes, node );
+		}
+
+		memcpy( grids[0], nuclide_grids[0], grid_bytes );
+		if( row_ints > 0 )
+			memcpy( index, energy_grid[0].xs_ptrs, index_bytes );
+		for( long i = 0; i < n_rows; i++ )
+		{
+			rows[i].energy = energy_grid[i].energy;
+			rows[i].xs_ptrs = ( row_ints > 0 ) ? index + ( energy_grid[i].xs_ptrs - energy_grid[0].xs_ptrs )
+			                                   : energy_grid[i].xs_ptrs;
+		}
+
+		lt->numa_nuclide_grids[node] = grids;
+		lt->numa_energy_grid[node] = rows;
+	}
+
+	printf("NUMA replicas: %.1f MB each, made in %.3f s\n",
+	       ( grid_bytes + row_bytes + index_bytes ) / 1048576.0, omp_get_wtime() - start_time);
+}
+
+// Sets up the views of the nuclide grids used by the SIMD unionized grid
+// lookups, which gather one field of several nuclides per instruction.
+// LAYOUT_SIMD gathers in place: NuclideGridPoint is padded to 64 bytes,
+// so each field is at a stride of 8 doubles. LAYOUT_SOA copies the grids
+// into one array per field.
+void generate_nuclide_simd( NuclideGridPoint ** nuclide_grids, long n_isotopes,
+                            long n_gridpoints, int layout, LookupTables * lt )
+{
+	if( layout == LAYOUT_SIMD )
+	{
+		lt->simd_stride = sizeof(NuclideGridPoint) / sizeof(double);
+		lt->simd_energy = &nuclide_grids[0][0].energy;
+		lt->simd_xs[0] = &nuclide_grids[0][0].total_xs;
+		lt->simd_xs[1] = &nuclide_grids[0][0].elastic_xs;
+		lt->simd_xs[2] = &nuclide_grids[0][0].absorbtion_xs;
+		lt->simd_xs[3] = &nuclide_grids[0][0].fission_xs;
+		lt->simd_xs[4] = &nuclide_grids[0][0].nu_fission_xs;
+		select_simd_isa( lt );
+		return;
+	}
+
+	printf("Generating Structure of Arrays Nuclide Grids...\n");
+
+	long n = n_isotopes * n_gridpoints;
+	lt->simd_stride = 1;
+	lt->simd_energy = (double *) alignedMalloc( n * sizeof(double) );
+	if( lt->simd_energy == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+	for( int k = 0; k < 5; k++ )
+	{
+		lt->simd_xs[k] = (double *) alignedMalloc( n * sizeof(double) );
+		if( lt->simd_xs[k] == NULL )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+	}
+
+	#pragma omp parallel for schedule(static)
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		for( long j = 0; j < n_gridpoints; j++ )
+		{
+			NuclideGridPoint * point = &nuclide_grids[i][j];
+			long k = i * n_gridpoints + j;
+			lt->simd_energy[k] = point->energy;
+			lt->simd_xs[0][k]  = point->total_xs;
+			lt->simd_xs[1][k]  = point->elastic_xs;
+			lt->simd_xs[2][k]  = point->absorbtion_xs;
+			lt->simd_xs[3][k]  = point->fission_xs;
+			lt->simd_xs[4][k]  = point->nu_fission_xs;
+		}
+	}
+
+	select_simd_isa( lt );
+}
+
+// Fills xs_ptrs for unionized grid rows [start, end). The sweep is seeded
+// from the last row before the range (or from the beginning of the grid).
+// The serial sweep advances each nuclide by at most one gridpoint per row,
+// so inside a run of equal unionized energies it can lag behind a binary
+// search; it is only guaranteed to have caught up at the end of such a
+// run. The seed is therefore taken at the row before the run containing
+// "start", and the rows of the run before "start" are swept without
+// being written.
+static void set_grid_ptrs_range( GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids,
+                                 long n_isotopes, long n_gridpoints,
+                                 long start, long end, LookupTables * lt )
+{
+	int * idx_low = (int *) malloc( n_isotopes * sizeof(int));
+	double * energy_high = (double *) malloc( n_isotopes * sizeof(double));
+
+	long e = start;
+	while( e > 0 && e < end && energy_grid[e-1].energy == energy_grid[e].energy )
+		e--;
+
+	for( long i = 0; i < n_isotopes; i++ )
+	{
+		if( e == 0 )
+			idx_low[i] = 0;
+		else
+			idx_low[i] = grid_search_nuclide( n_gridpoints, energy_grid[e-1].energy,
+			                                  nuclide_grids[i], 0, n_gridpoints-1 );
+		energy_high[i] = nuclide_grids[i][idx_low[i]+1].energy;
+	}
+
+	for( ; e < end; e++ )
+	{
+		double unionized_energy = energy_grid[e].energy;
+		for( long i = 0; i < n_isotopes; i++ )
+		{
+			if( unionized_energy >= energy_high[i] && idx_low[i] != n_gridpoints - 2 )
+			{
+				idx_low[i]++;
+				energy_high[i] = nuclide_grids[i][idx_low[i]+1].energy;
+			}
+		}
+
+		if( e < start )
+			continue;
+
+		if( lt->index_type == INDEX_SHORT )
+		{
+			unsigned short * row = &lt->xs_u16[e * n_isotopes];
+			for( long i = 0; i < n_isotopes; i++ )
+				row[i] = (unsigned short) idx_low[i];
+		}
+		else if( lt->index_type == INDEX_DELTA )
+		{
+			int * base = &lt->xs_base[(e / DELTA_BLOCK) * n_isotopes];
+			unsigned char * row = &lt->xs_delta[e * n_isotopes];
+			if( e % DELTA_BLOCK == 0 )
+				memcpy( base, idx_low, n_isotopes * sizeof(int) );
+			for( long i = 0; i < n_isotopes; i++ )
+				row[i] = (unsigned char) (idx_low[i] - base[i]);
+		}
+		else if( lt->index_type == INDEX_MATERIAL )
+		{
+			for( int m = 0; m < N_MATERIALS; m++ )
+			{
+				int * row = &lt->mat_xs[m][e * lt->mat_num_nucs[m]];
+				for( int j = 0; j < lt->mat_num_nucs[m]; j++ )
+					row[j] = idx_low[lt->mat_nucs[m][j]];
+			}
+		}
+		else
+			memcpy( energy_grid[e].xs_ptrs, idx_low, n_isotopes * sizeof(int) );
+	}
+
+	free(idx_low);
+	free(energy_high);
+}
+
 // Initializes the unionized energy grid, by locating the appropriate
 // location in the nulicde grid for each entry on the unionized grid.
 // This function should not be profiling when doing performance analysis or tuning.
@@ -154,10 +1111,16 @@ GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
 // should exclude it from their analysis, or otherwise wash it out by increasing
 // the amount of time spent in the simulation portion of the application by running
 // more lookups with the "-l" command line argument.
-// This function is not parallelized due to false sharing issues that arrise when writing
-// to the UEG.
+// To avoid false sharing when writing to the UEG, the grid is split into
+// one range of rows per thread, with every range starting on a cache line
+// boundary of the xs_ptrs array. Each thread seeds its own sweep with a
+// binary search per nuclide, so the result is identical to a serial sweep.
+// With a compact index (lt->index_type), the xs_ptrs are written to the
+// 16-bit, base + delta or per-material tables in lt instead of the
+// GridPoint arrays. The per-material tables are built for the materials
+// in lt->mat_num_nucs and lt->mat_nucs.
 void initialization_do_not_profile_set_grid_ptrs( GridPoint *  energy_grid, NuclideGridPoint **  nuclide_grids, 
-						long n_isotopes, long n_gridpoints )
+						long n_isotopes, long n_gridpoints, LookupTables * lt )
 {
 	int mype = 0;
 
@@ -167,33 +1130,77 @@ void initialization_do_not_profile_set_grid_ptrs( GridPoint *  energy_grid, Nucl
 
 	if( mype == 0 ) printf("Assigning pointers to Unionized Energy Grid...\n");
 
-	int * idx_low = (int *) calloc( n_isotopes, sizeof(int));
-	double * energy_high = (double *) malloc( n_isotopes * sizeof(double));
+	long n_unionized_grid_points = n_isotopes * n_gridpoints;
+	long row_bytes = n_isotopes * sizeof(int);
 
-	for( int i = 0; i < n_isotopes; i++ )
-		energy_high[i] = nuclide_grids[i][1].energy;
-
-	for( long e = 0; e < n_isotopes * n_gridpoints; e++ )
+	if( lt->index_type == INDEX_SHORT )
 	{
-		double unionized_energy = energy_grid[e].energy;
-		for( long i = 0; i < n_isotopes; i++ )
+		lt->xs_u16 = (unsigned short *) huge_malloc( n_unionized_grid_points
+		             * n_isotopes * sizeof(unsigned short), lt->pages );
+		row_bytes = n_isotopes * sizeof(unsigned short);
+		if( lt->xs_u16 == NULL )
 		{
-			if( unionized_energy < energy_high[i]  )
-				energy_grid[e].xs_ptrs[i] = idx_low[i];
-			else if( idx_low[i] == n_gridpoints - 2 )
-				energy_grid[e].xs_ptrs[i] = idx_low[i];
-			else
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+	}
+	else if( lt->index_type == INDEX_DELTA )
+	{
+		long n_blocks = (n_unionized_grid_points + DELTA_BLOCK - 1) / DELTA_BLOCK;
+		lt->xs_base = (int *) alignedMalloc( n_blocks * n_isotopes * sizeof(int) );
+		lt->xs_delta = (unsigned char *) huge_malloc( n_unionized_grid_points
+		               * n_isotopes * sizeof(unsigned char), lt->pages );
+		row_bytes = n_isotopes * sizeof(unsigned char);
+		if( lt->xs_base == NULL || lt->xs_delta == NULL )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+	}
+	else if( lt->index_type == INDEX_MATERIAL )
+	{
+		lt->mat_xs = (int **) malloc( N_MATERIALS * sizeof(int *) );
+		for( int m = 0; m < N_MATERIALS; m++ )
+		{
+			lt->mat_xs[m] = (int *) huge_malloc( n_unionized_grid_points
+			                * lt->mat_num_nucs[m] * sizeof(int), lt->pages );
+			if( lt->mat_xs[m] == NULL )
 			{
-				idx_low[i]++;
-				energy_grid[e].xs_ptrs[i] = idx_low[i];
-				energy_high[i] = nuclide_grids[i][idx_low[i]+1].energy;
+				fprintf(stderr,"ERROR - Out Of Memory!\n");
+				exit(1);
 			}
-
 		}
+		// 16 rows of every material's table span whole cache lines
+		row_bytes = 4;
 	}
 
-	free(idx_low);
-	free(energy_high);
+	// Smallest number of rows that spans a whole number of cache lines
+	long a = 64, b = row_bytes;
+	while( b != 0 )
+	{
+		long t = a % b;
+		a = b;
+		b = t;
+	}
+	long row_align = 64 / a;
+
+	// Each base + delta block must be written by a single thread
+	if( lt->index_type == INDEX_DELTA )
+		row_align = DELTA_BLOCK;
+
+	long n_ranges = omp_get_max_threads();
+
+	#pragma omp parallel for schedule(static,1)
+	for( long r = 0; r < n_ranges; r++ )
+	{
+		long start = (r * n_unionized_grid_points / n_ranges) / row_align * row_align;
+		long end = n_unionized_grid_points;
+		if( r + 1 < n_ranges )
+			end = ((r+1) * n_unionized_grid_points / n_ranges) / row_align * row_align;
+
+		set_grid_ptrs_range( energy_grid, nuclide_grids, n_isotopes,
+		                     n_gridpoints, start, end, lt );
+	}
 
 	/* Alternative method with high stride access, less efficient
 	//#pragma omp parallel for schedule(dynamic,1)
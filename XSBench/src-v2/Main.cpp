@@ -50,14 +50,18 @@ int main( int argc, char* argv[] )
 	// rand() is only used in the serial initialization stages.
 	// A custom RNG is used in parallel portions.
 	#ifdef VERIFICATION
-	srand(26);
+	unsigned long rng_seed = 26;
 	#else
-	srand(time(NULL));
+	unsigned long rng_seed = time(NULL);
 	#endif
+	srand(rng_seed);
 
 	// Process CLI Fields -- store in "Inputs" structure
 	Inputs in = read_CLI( argc, argv );
 
+	// Set number of OpenMP Threads
+	omp_set_num_threads(in.nthreads);
+
 	// Print-out of Input Summary
 	if( mype == 0 )
 		print_inputs( in, nprocs, version );
@@ -66,57 +70,80 @@ int main( int argc, char* argv[] )
 	// Prepare Nuclide Energy Grids, Unionized Energy Grid, & Material Data
 	// =====================================================================
 
-	// Allocate & fill energy grids
-	#ifndef BINARY_READ
+	// If using a unionized grid search, initialize the energy grid
+	// Otherwise, leave these as null
+	GridPoint * energy_grid = NULL;
+	LookupTables lt = {0};
+	lt.index_type = in.index_type;
+	lt.pages = in.pages;
+
+	// Map the grids from the binary file, or allocate & fill them
+	#ifdef BINARY_READ
+	if( mype == 0 ) printf("Mapping data from \"XS_data.dat\" file...\n");
+	double * concs_data = NULL;
+	NuclideGridPoint ** nuclide_grids = binary_read( in, &energy_grid, &concs_data );
+	#else
 	if( mype == 0) printf("Generating Nuclide Energy Grids...\n");
-	#endif
 
-	NuclideGridPoint ** nuclide_grids = gpmatrix(in.n_isotopes,in.n_gridpoints);
+	NuclideGridPoint ** nuclide_grids = gpmatrix(in.n_isotopes,in.n_gridpoints,in.pages);
 	
-	generate_grids( nuclide_grids, in.n_isotopes, in.n_gridpoints );	
+	if( in.rng == RNG_COUNTER )
+		generate_grids_counter( nuclide_grids, in.n_isotopes, in.n_gridpoints, rng_seed );
+	else
+		generate_grids( nuclide_grids, in.n_isotopes, in.n_gridpoints );	
 
 	// Sort grids by energy
-	#ifndef BINARY_READ
 	if( mype == 0) printf("Sorting Nuclide Energy Grids...\n");
 	sort_nuclide_grids( nuclide_grids, in.n_isotopes, in.n_gridpoints );
 	#endif
 
-	// If using a unionized grid search, initialize the energy grid
-	// Otherwise, leave these as null
-	GridPoint * energy_grid = NULL;
-	//int * index_data = NULL;
-
 	if( in.grid_type == UNIONIZED )
 	{
-		// Prepare Unionized Energy Grid Framework
+		// Prepare Unionized Energy Grid Framework. The binary file
+		// carries the energies, and the xs_ptrs of INDEX_INT.
 		#ifndef BINARY_READ
 		energy_grid = generate_energy_grid( in.n_isotopes,
-				in.n_gridpoints, nuclide_grids ); 	
-		#else
-		energy_grid = (GridPoint *)malloc( in.n_isotopes *
-				in.n_gridpoints * sizeof( GridPoint ) );
-		index_data = (int *) malloc( in.n_isotopes * in.n_gridpoints
-				* in.n_isotopes * sizeof(int));
-		for( int i = 0; i < in.n_isotopes*in.n_gridpoints; i++ )
-			energy_grid[i].xs_ptrs = &index_data[i*in.n_isotopes];
+				in.n_gridpoints, nuclide_grids, in.index_type, in.pages ); 	
 		#endif
 
 		// Double Indexing. Filling in energy_grid with pointers to the
-		// nuclide_energy_grids.
-		#ifndef BINARY_READ
-		initialization_do_not_profile_set_grid_ptrs( energy_grid, nuclide_grids, in.n_isotopes, in.n_gridpoints );
+		// nuclide_energy_grids. The per-material index is filled in once
+		// the materials are loaded.
+		#ifdef BINARY_READ
+		if( in.index_type != INDEX_MATERIAL && in.index_type != INDEX_INT )
+		#else
+		if( in.index_type != INDEX_MATERIAL )
 		#endif
+			initialization_do_not_profile_set_grid_ptrs( energy_grid, nuclide_grids, in.n_isotopes, in.n_gridpoints, &lt );
 	}
-	/*
 	else if( in.grid_type == HASH )
 	{
 		energy_grid = generate_hash_table( nuclide_grids, in.n_isotopes, in.n_gridpoints, in.hash_bins );
 	}
-	*/
-	#ifdef BINARY_READ
-	if( mype == 0 ) printf("Reading data from \"XS_data.dat\" file...\n");
-	binary_read(in.n_isotopes, in.n_gridpoints, nuclide_grids, energy_grid, in.grid_type);
-	#endif
+	else if( in.grid_type == LOGHASH )
+	{
+		energy_grid = generate_loghash_table( nuclide_grids, in.n_isotopes, in.n_gridpoints, in.hash_bins, &lt );
+	}
+
+	// Alternative unionized grid search structures (host only)
+	lt.search_type = in.search_type;
+	if( in.grid_type == UNIONIZED && in.search_type == SEARCH_EYTZINGER )
+		generate_eytzinger_grid( energy_grid, in.n_isotopes * in.n_gridpoints, &lt );
+	else if( in.grid_type == UNIONIZED && in.search_type == SEARCH_KARY )
+		generate_kary_grid( energy_grid, in.n_isotopes * in.n_gridpoints, &lt );
+	else if( in.grid_type == UNIONIZED && in.search_type == SEARCH_BSCACHE )
+		generate_bscache( energy_grid, in.n_isotopes * in.n_gridpoints, &lt );
+
+	lt.interp = in.interp;
+	if( in.interp == INTERP_SLOPE )
+		generate_slope_grid( nuclide_grids, in.n_isotopes, in.n_gridpoints, &lt );
+
+	if( in.precision == PRECISION_MIXED )
+		generate_float_grid( nuclide_grids, in.n_isotopes, in.n_gridpoints, &lt );
+
+	lt.layout = in.layout;
+	if( in.layout != LAYOUT_AOS )
+		generate_nuclide_simd( nuclide_grids, in.n_isotopes, in.n_gridpoints, in.layout, &lt );
 
 	// Get material data
 	if( mype == 0 )
@@ -124,15 +151,47 @@ int main( int argc, char* argv[] )
 	int *num_nucs  = load_num_nucs(in.n_isotopes);
 	int **mats     = load_mats(num_nucs, in.n_isotopes);
 
-	double **concs = load_concs(num_nucs);
+	if( in.grid_type == UNIONIZED && in.index_type == INDEX_MATERIAL )
+	{
+		lt.mat_num_nucs = num_nucs;
+		lt.mat_nucs = mats;
+		initialization_do_not_profile_set_grid_ptrs( energy_grid, nuclide_grids, in.n_isotopes, in.n_gridpoints, &lt );
+	}
+
+	double **concs;
+	#ifdef BINARY_READ
+	concs = load_concs_binary(num_nucs, concs_data);
+	#else
+	if( in.rng == RNG_COUNTER )
+		concs = load_concs_counter(num_nucs, rng_seed);
+	else
+		concs = load_concs(num_nucs);
+	#endif
+
+	if( in.precision == PRECISION_MIXED )
+		lt.float_concs = load_concs_float(num_nucs, concs);
+
+	if( in.tables == TABLES_MACRO )
+		generate_macro_tables( nuclide_grids, in.n_gridpoints, num_nucs, mats, concs, &lt );
+
+	// Spread or replicate the grids over the NUMA nodes
+	if( in.numa != NUMA_NONE )
+		generate_numa_placement( in, energy_grid, nuclide_grids, &lt );
 
 	#ifdef BINARY_DUMP
 	if( mype == 0 ) printf("Dumping data to binary file...\n");
-	binary_dump(in.n_isotopes, in.n_gridpoints, nuclide_grids, energy_grid, in.grid_type);
+	binary_dump( in, nuclide_grids, energy_grid, num_nucs, concs );
 	if( mype == 0 ) printf("Binary file \"XS_data.dat\" written! Exiting...\n");
 	return 0;
 	#endif
 
+	if( in.device == HOST )
+	{
+		report_huge_pages();
+		run_host_simulation(in, energy_grid, nuclide_grids, num_nucs, mats, concs, &lt);
+		return 0;
+	}
+
 	// =====================================================================
 	// Cross Section (XS) Parallel Lookup Simulation
 	// =====================================================================
@@ -145,8 +204,18 @@ int main( int argc, char* argv[] )
 	}
 
 	long n_iso_grid = in.n_isotopes * in.n_gridpoints;
-	double *energy = (double *) alignedMalloc(n_iso_grid * sizeof(double));
-	int *energy_grid_xs = (int *) alignedMalloc(n_iso_grid * in.n_isotopes * sizeof(int));	
+	double *energy = (double *) huge_malloc(n_iso_grid * sizeof(double), in.pages);
+	// The 16-bit index is already stored flat, the 32-bit one is gathered
+	// from the GridPoint arrays below
+	void *energy_grid_xs = lt.xs_u16;
+	if( in.index_type == INDEX_INT )
+		energy_grid_xs = huge_malloc(n_iso_grid * in.n_isotopes * sizeof(int), in.pages);
+	if( in.numa == NUMA_INTERLEAVE )
+	{
+		place_numa_memory(energy, n_iso_grid * sizeof(double), NUMA_ALL_NODES);
+		if( in.index_type == INDEX_INT )
+			place_numa_memory(energy_grid_xs, n_iso_grid * in.n_isotopes * sizeof(int), NUMA_ALL_NODES);
+	}
 	num_points = 0;
         for (int i = 0; i < NUM_STAGE; i++)
                 num_points += pow(2, i);
@@ -162,28 +231,32 @@ int main( int argc, char* argv[] )
                         h_inCache[sample].index = i;
                         sample++;
                 }
-		int index = i * in.n_isotopes;
-		for(int j = 0; j < in.n_isotopes; j++)
-			energy_grid_xs[index + j] = energy_grid[i].xs_ptrs[j];
+		if( in.index_type == INDEX_INT )
+			memcpy((int *) energy_grid_xs + i * in.n_isotopes, energy_grid[i].xs_ptrs,
+			       in.n_isotopes * sizeof(int));
 	}
 
+	report_huge_pages();
+
 	unsigned long *vhash = (unsigned long *) alignedMalloc(sizeof(unsigned long));
 	if(!init())
 		return false;
 	printf("Init complete!\n");
 	// Run simulation
-	run_simulation(in, energy, energy_grid_xs, energy_grid, nuclide_grids, num_nucs, mats, concs, vhash);
+	run_simulation(in, energy, energy_grid_xs, energy_grid, nuclide_grids, num_nucs, mats, concs, vhash, &lt);
 	cleanup();
 	return 0;
 }
 
-void run_simulation(Inputs in, double *energy, int *energy_grid_xs,
+void run_simulation(Inputs in, double *energy, void *energy_grid_xs,
 		GridPoint *energy_grid,
 		NuclideGridPoint **nuclide_grids, 
 		int *num_nucs, int **mats, double **concs, 
-		unsigned long *vhash)
+		unsigned long *vhash, LookupTables *lt)
 {
 	long n_iso_grid = in.n_isotopes * in.n_gridpoints;
+	// Must match the xs_index_t the kernels were compiled with
+	size_t xs_index_size = (in.index_type == INDEX_SHORT) ? sizeof(cl_ushort) : sizeof(cl_int);
 	int total_nucs = 0;
 	for(int i = 0; i < 12; i++)
 		total_nucs += num_nucs[i];
@@ -193,7 +266,7 @@ void run_simulation(Inputs in, double *energy, int *energy_grid_xs,
   	d_energy = clCreateBuffer(context, CL_MEM_READ_ONLY, n_iso_grid * sizeof(double), NULL, &status);
 	checkError(status, "Failed to create energy input buffer.\n");
 	
-	d_energy_grid_xs = clCreateBuffer(context, CL_MEM_READ_ONLY, n_iso_grid * in.n_isotopes * sizeof(cl_int), NULL, &status);
+	d_energy_grid_xs = clCreateBuffer(context, CL_MEM_READ_ONLY, n_iso_grid * in.n_isotopes * xs_index_size, NULL, &status);
 	checkError(status, "Failed to create input energy_grid_xs buffer. \n");
 
 	d_nuclide_grids = clCreateBuffer(context, CL_MEM_READ_ONLY, n_iso_grid * sizeof(cl_double8), NULL, &status);
@@ -205,7 +278,7 @@ void run_simulation(Inputs in, double *energy, int *energy_grid_xs,
 	status = clEnqueueWriteBuffer(queues[K_GRIDSEARCH], d_energy, CL_TRUE, 0, n_iso_grid * sizeof(double), energy, 0, NULL, NULL);
 	checkError(status, "Failed to enqueue write buffer.\n");
 
-	status = clEnqueueWriteBuffer(queues[K_CAL_MACRO_XS_ONE], d_energy_grid_xs, CL_TRUE, 0, n_iso_grid * in.n_isotopes * sizeof(cl_int), energy_grid_xs, 0, NULL, NULL);
+	status = clEnqueueWriteBuffer(queues[K_CAL_MACRO_XS_ONE], d_energy_grid_xs, CL_TRUE, 0, n_iso_grid * in.n_isotopes * xs_index_size, energy_grid_xs, 0, NULL, NULL);
 	checkError(status, "Failed to enqueue write buffer.\n");
  
 	status = clEnqueueWriteBuffer(queues[K_CAL_MACRO_XS_ONE], d_nuclide_grids, CL_TRUE, 0, n_iso_grid * sizeof(cl_double8), *nuclide_grids, 0, NULL, NULL);
@@ -277,7 +350,7 @@ void run_simulation(Inputs in, double *energy, int *energy_grid_xs,
 	#ifdef VERIFICATION
 	printf("\nVerifying\n");
 	unsigned long vhash_verify = 0;
-	run_event_based_simulation(in, energy_grid, nuclide_grids, num_nucs, mats, concs, 0, &vhash_verify);
+	run_event_based_simulation(in, energy_grid, nuclide_grids, num_nucs, mats, concs, 0, &vhash_verify, lt);
 	vhash_verify = vhash_verify % 1000000;
 	if(*vhash == vhash_verify)
 		printf("Verification PASS.\n");
@@ -290,6 +363,55 @@ void run_simulation(Inputs in, double *energy, int *energy_grid_xs,
 	printf("\nProcessing time = %.4fms\n", (float)(time * 1E3));
 }
 
+// Runs the lookups on the host CPU instead of the FPGA
+void run_host_simulation(Inputs in, GridPoint *energy_grid,
+		NuclideGridPoint **nuclide_grids,
+		int *num_nucs, int **mats, double **concs,
+		LookupTables *lt)
+{
+	if( in.kernels == KERNELS_BENCH )
+	{
+		run_kernel_benchmark(in, energy_grid, nuclide_grids, num_nucs, mats, concs, lt);
+		return;
+	}
+
+	unsigned long long vhash = 0;
+
+	double time = getCurrentTimestamp();
+	if( in.simulation_method == EVENT_BASED )
+	{
+		unsigned long vhash_event = 0;
+		run_event_based_simulation(in, energy_grid, nuclide_grids, num_nucs, mats, concs, 0, &vhash_event, lt);
+		vhash = vhash_event;
+	}
+	else
+		run_history_based_simulation(in, energy_grid, nuclide_grids, num_nucs, mats, concs, 0, &vhash, lt);
+	time = getCurrentTimestamp() - time;
+
+	printf("\n" );
+	printf("Simulation complete.\n" );
+
+	// Final Hash Step
+	vhash = vhash % 1000000;
+
+	print_results( in, 0, time, 1, vhash );
+
+	// Accuracy of the approximate lookup modes. Mixed precision and the
+	// macro tables always report it, the slope grid is checked in
+	// verification mode.
+	if( in.tables == TABLES_MACRO )
+		printf("Macro table max relative error vs. micro XS sums: %.3e\n",
+		       lookup_max_rel_error(in, energy_grid, nuclide_grids, num_nucs, mats, concs, lt));
+	else if( in.precision == PRECISION_MIXED )
+		printf("Max relative error vs. double precision: %.3e\n",
+		       lookup_max_rel_error(in, energy_grid, nuclide_grids, num_nucs, mats, concs, lt));
+	#ifdef VERIFICATION
+	else if( in.interp == INTERP_SLOPE )
+		printf("Slope grid max relative error vs. interpolation: %.3e\n",
+		       lookup_max_rel_error(in, energy_grid, nuclide_grids, num_nucs, mats, concs, lt));
+	#endif
+}
+
 // Set up the context, device, kernels, and buffers...
 bool init()
 {
@@ -134,6 +134,61 @@ double ** load_concs( int * num_nucs )
 
 	return concs;
 }
+// Counter based RNG version of load_concs. Uses a separate stream from
+// the nuclide grids, keyed on the position in the concs array.
+double ** load_concs_counter( int * num_nucs, unsigned long seed )
+{
+	double **concs = (double **)alignedMalloc( 12 * sizeof( double *) );
+	int total_nucs = 0;
+	for(int i = 0; i < 12; i++)
+		total_nucs += num_nucs[i];
+	double *concs_sub = (double *) alignedMalloc(total_nucs * sizeof(double));
+	int nucs_idx = 0;
+	for( int i = 0; i < 12; i++ ) {
+		concs[i] = &concs_sub[nucs_idx];
+		nucs_idx += num_nucs[i];
+	}
+
+	for( int j = 0; j < total_nucs; j++ )
+		concs_sub[j] = rn_counter(~seed, j);
+
+	return concs;
+}
+
+// concs over the flat array read from the binary file, without a copy
+double ** load_concs_binary( int * num_nucs, double * concs_data )
+{
+	double **concs = (double **)alignedMalloc( 12 * sizeof( double *) );
+	int nucs_idx = 0;
+	for( int i = 0; i < 12; i++ ) {
+		concs[i] = &concs_data[nucs_idx];
+		nucs_idx += num_nucs[i];
+	}
+
+	return concs;
+}
+
+// Single precision copy of concs, for the mixed precision lookups
+float ** load_concs_float( int * num_nucs, double ** concs )
+{
+	float **concs_f = (float **)alignedMalloc( 12 * sizeof( float *) );
+	int total_nucs = 0;
+	for(int i = 0; i < 12; i++)
+		total_nucs += num_nucs[i];
+	float *concs_sub = (float *) alignedMalloc(total_nucs * sizeof(float));
+	int nucs_idx = 0;
+	for( int i = 0; i < 12; i++ ) {
+		concs_f[i] = &concs_sub[nucs_idx];
+		nucs_idx += num_nucs[i];
+	}
+
+	for( int i = 0; i < 12; i++ )
+		for( int j = 0; j < num_nucs[i]; j++ )
+			concs_f[i][j] = concs[i][j];
+
+	return concs_f;
+}
+
 /*
 // Verification version of this function (tighter control over RNG)
 double ** load_concs_v( int * num_nucs )
@@ -152,7 +207,15 @@ double ** load_concs_v( int * num_nucs )
 */
 
 // picks a material based on a probabilistic distribution
-int pick_mat( unsigned long * seed )
+// Cumulative material distribution used by pick_mat and sample_particles.
+// Material i is picked when roll < threshold[i] and every lower material
+// failed. The thresholds keep the summation order of the original running
+// sum loop, so the picks are bit for bit the same.
+typedef struct{
+	double threshold[N_MATERIALS];
+} MatCDF;
+
+static MatCDF build_mat_cdf( void )
 {
 	// I have a nice spreadsheet supporting these numbers. They are
 	// the fractions (by volume) of material in the core. Not a 
@@ -175,18 +238,116 @@ int pick_mat( unsigned long * seed )
 	dist[9]  = 0.015;	// top nozzle
 	dist[10] = 0.025;	// top of fuel assemblies
 	dist[11] = 0.013;	// bottom of fuel assemblies
-	
-	double roll = rn(seed);
 
-	// makes a pick based on the distro
+	// Fuel takes the rolls past the other materials' total
+	MatCDF cdf;
 	for( int i = 0; i < 12; i++ )
 	{
 		double running = 0;
 		for( int j = i; j > 0; j-- )
 			running += dist[j];
-		if( roll < running )
-			return i;
+		cdf.threshold[i] = running;
 	}
 
+	// The thresholds must increase for the counting in mat_from_roll
+	for( int i = 1; i < 12; i++ )
+		assert( cdf.threshold[i] > cdf.threshold[i-1] );
+
+	return cdf;
+}
+
+static const MatCDF mat_cdf = build_mat_cdf();
+
+// The material of a roll: one more than the thresholds at or below it,
+// or fuel past the last one. Branch free, for the SIMD sampler.
+static inline __attribute__((always_inline)) int mat_from_roll( double roll )
+{
+	int below = 0;
+	for( int i = 1; i < 12; i++ )
+		below += ( mat_cdf.threshold[i] <= roll );
+	return ( below + 1 ) % 12;
+}
+
+int pick_mat( unsigned long * seed )
+{
+	double roll = rn(seed);
+
+	// makes a pick based on the distro
+	for( int i = 1; i < 12; i++ )
+		if( roll < mat_cdf.threshold[i] )
+			return i;
+
 	return 0;
 }
+
+// x % m for m = 2^31 - 1, as 2^31 = 1 (mod m)
+static inline __attribute__((always_inline)) unsigned long mod_mersenne31( unsigned long x )
+{
+	const unsigned long m = 2147483647;
+	x = ( x & m ) + ( x >> 31 );
+	x = ( x & m ) + ( x >> 31 );
+	return x - ( m & -(unsigned long) ( x >= m ) );
+}
+
+// Energy and material of the first lookup of each of n particles, from
+// particle ID first on. These are the values rn then pick_mat give for
+// the seed (ID + 1) * 13371337, computed SAMPLE_BLOCK particles at a time
+// with the Park & Miller step's modulo done as a Mersenne reduction, so
+// that the loop vectorises.
+static inline __attribute__((always_inline))
+void sample_particles_body( long first, int n, double * p_energy, int * mat )
+{
+	const unsigned long a = 16807;
+	const unsigned long m = 2147483647;
+
+	#pragma omp simd
+	for( int j = 0; j < n; j++ )
+	{
+		unsigned long seed = ((unsigned long) (first + j) + (unsigned long)1) * (unsigned long) 13371337;
+
+		unsigned long x = mod_mersenne31( a * seed );
+		double energy = (double) (int) x / m;
+		x = mod_mersenne31( a * x );
+		double roll = (double) (int) x / m;
+
+		p_energy[j] = energy;
+		mat[j] = mat_from_roll( roll );
+	}
+}
+
+static void sample_particles_scalar( long first, int n, double * p_energy, int * mat )
+{
+	sample_particles_body( first, n, p_energy, mat );
+}
+
+__attribute__((target("avx2")))
+static void sample_particles_avx2( long first, int n, double * p_energy, int * mat )
+{
+	sample_particles_body( first, n, p_energy, mat );
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static void sample_particles_avx512( long first, int n, double * p_energy, int * mat )
+{
+	sample_particles_body( first, n, p_energy, mat );
+}
+
+typedef void (*SampleParticles)( long first, int n, double * p_energy, int * mat );
+
+// Picks the widest SIMD the CPU supports
+static SampleParticles select_sample_particles( void )
+{
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") )
+		return sample_particles_avx512;
+	if( __builtin_cpu_supports("avx2") )
+		return sample_particles_avx2;
+	return sample_particles_scalar;
+}
+
+static const SampleParticles sample_particles_isa = select_sample_particles();
+
+void sample_particles( long first, int n, double * p_energy, int * mat )
+{
+	sample_particles_isa( first, n, p_energy, mat );
+}
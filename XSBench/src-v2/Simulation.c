@@ -1,16 +1,70 @@
 #include "XSbench_header.h"
+using namespace aocl_utils;
 
-void run_event_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long * vhash_result)
+// Whether the lookups specialised on xs_t, GRID and K are the ones to run
+// with the options in. The kernels are tried in FOR_EACH_KERNEL order,
+// which ends with the generic ones, so those run for any grid type, index,
+// search and layout no kernel is specialised on. The macro table lookups
+// do not use the grids.
+template <typename xs_t, int GRID, int K>
+static bool is_kernel( Inputs & in )
+{
+	if( GRID == GRID_MACRO || in.tables == TABLES_MACRO )
+		return GRID == GRID_MACRO && in.tables == TABLES_MACRO;
+	if( ( in.precision == PRECISION_MIXED ) != ( sizeof(xs_t) == sizeof(float) ) )
+		return false;
+	if( GRID == GRID_ANY )
+		return true;
+	if( in.kernels == KERNELS_GENERIC || in.grid_type != GRID )
+		return false;
+	return K == KERNEL( in.index_type, in.search_type, in.layout, in.interp );
+}
+
+template <typename xs_t, int GRID, int K>
+static void event_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long * vhash_result, LookupTables * lt)
 {
 	if( mype == 0)	
 		printf("Beginning event based simulation...\n");
 
+	// Event bank, shared by the threads: the lookups' energies, materials
+	// and results in bank order, and their energies sorted with the bank
+	// positions they came from
+	double * bank_energy = NULL;
+	int * bank_mat = NULL;
+	double * bank_xs = NULL;
+	unsigned long * bank_keys = NULL, * bank_tmp_keys = NULL;
+	int * bank_ids = NULL, * bank_tmp_ids = NULL;
+	long * bank_hist = NULL;
+	int * bank_tasks = NULL;
+	int n_tasks = 0;
+	if( in.bank > 0 )
+	{
+		bank_energy = (double *) malloc( in.bank * sizeof(double) );
+		bank_mat = (int *) malloc( in.bank * sizeof(int) );
+		bank_xs = (double *) malloc( 5 * in.bank * sizeof(double) );
+		bank_keys = (unsigned long *) malloc( in.bank * sizeof(unsigned long) );
+		bank_tmp_keys = (unsigned long *) malloc( in.bank * sizeof(unsigned long) );
+		bank_ids = (int *) malloc( in.bank * sizeof(int) );
+		bank_tmp_ids = (int *) malloc( in.bank * sizeof(int) );
+		bank_hist = (long *) malloc( in.nthreads * RADIX_BUCKETS * sizeof(long) );
+		// (start, lookups, material) of each material queue task
+		bank_tasks = (int *) malloc( 3 * (in.bank + N_MATERIALS) * sizeof(int) );
+		if( !bank_energy || !bank_mat || !bank_xs || !bank_keys || !bank_tmp_keys ||
+		    !bank_ids || !bank_tmp_ids || !bank_hist || !bank_tasks )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+	}
+
 	unsigned long long vhash = 0;
 	// OpenMP compiler directives - declaring variables as shared or private
 	// The reduction is only needed when in verification mode.
 	#pragma omp parallel default(none) \
 	shared( in, energy_grid, nuclide_grids, \
-			mats, concs, num_nucs, mype) \
+			mats, concs, num_nucs, mype, lt, \
+			bank_energy, bank_mat, bank_xs, bank_keys, bank_tmp_keys, \
+			bank_ids, bank_tmp_ids, bank_hist, bank_tasks, n_tasks) \
 	reduction(+:vhash)
 	{	
 		// Initialize parallel PAPI counters
@@ -28,59 +82,230 @@ void run_event_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridP
 		// Initialize RNG seeds for threads
 		int thread = omp_get_thread_num();
 
+		// Threads read the grids replicated on their NUMA node
+		int node = thread_numa_node( lt, thread, in.nthreads );
+		GridPoint * local_energy_grid = lt->numa_energy_grid ? lt->numa_energy_grid[node] : energy_grid;
+		NuclideGridPoint ** local_nuclide_grids = lt->numa_nuclide_grids ? lt->numa_nuclide_grids[node] : nuclide_grids;
+
+		// Energy Sorted XS Lookup Loop
+		// Same lookups as below, generated in.bank at a time and run in
+		// order of increasing energy, so that consecutive lookups read
+		// neighbouring parts of the grids. Each thread's search starts from
+		// the row its previous lookup found. The results are written back
+		// to the lookups' bank positions and hashed in the original order.
+		if( in.bank > 0 )
+		{
+			long hint = 0;
+			for( int b = 0; b < in.lookups; b += in.bank )
+			{
+				int n = in.lookups - b;
+				if( n > in.bank )
+					n = in.bank;
+
+				// Particles are seeded by their particle ID
+				#pragma omp for schedule(static)
+				for( int s = 0; s < n; s += SAMPLE_BLOCK )
+				{
+					int count = ( n - s < SAMPLE_BLOCK ) ? n - s : SAMPLE_BLOCK;
+					sample_particles( b + s, count, &bank_energy[s], &bank_mat[s] );
+
+					// Energies are positive, so their bits sort in the same order
+					memcpy(&bank_keys[s], &bank_energy[s], count * sizeof(double));
+					for( int j = s; j < s + count; j++ )
+						bank_ids[j] = j;
+				}
+
+				sort_event_bank( n, bank_keys, bank_ids, bank_tmp_keys, bank_tmp_ids, bank_hist );
+
+				// Material queues: a second, stable sort by material keeps
+				// each material's lookups in energy order. The materials are
+				// then split into tasks of about QUEUE_TASK_WORK micro XS
+				// lookups, taken by the threads as they become free, so the
+				// fuel's lookups are spread by their work rather than count.
+				if( in.queue == QUEUE_MATERIAL )
+				{
+					#pragma omp for schedule(static)
+					for( int j = 0; j < n; j++ )
+						bank_keys[j] = bank_mat[bank_ids[j]];
+
+					sort_event_bank( n, bank_keys, bank_ids, bank_tmp_keys, bank_tmp_ids, bank_hist );
+
+					#pragma omp single
+					{
+						n_tasks = 0;
+						int start = 0;
+						for( int m = 0; m < N_MATERIALS; m++ )
+						{
+							// Find the end of material m's lookups
+							int lo = start;
+							int hi = n;
+							while( lo < hi )
+							{
+								int mid = lo + ( hi - lo ) / 2;
+								if( bank_keys[mid] <= (unsigned long) m )
+									lo = mid + 1;
+								else
+									hi = mid;
+							}
+
+							int chunk = QUEUE_TASK_WORK / num_nucs[m];
+							if( chunk < 1 )
+								chunk = 1;
+							for( int t = start; t < lo; t += chunk )
+							{
+								bank_tasks[3*n_tasks] = t;
+								bank_tasks[3*n_tasks + 1] = ( lo - t < chunk ) ? lo - t : chunk;
+								bank_tasks[3*n_tasks + 2] = m;
+								n_tasks++;
+							}
+							start = lo;
+						}
+					}
+
+					#pragma omp for schedule(dynamic)
+					for( int t = 0; t < n_tasks; t++ )
+						calculate_macro_xs_queue<xs_t, GRID, K>( &bank_ids[bank_tasks[3*t]],
+								bank_tasks[3*t + 1], bank_energy, bank_tasks[3*t + 2],
+								in.n_isotopes, in.n_gridpoints, num_nucs, concs,
+								local_energy_grid, local_nuclide_grids, mats,
+								bank_xs, in.grid_type, in.hash_bins, lt, &hint );
+				}
+				else
+				#pragma omp for schedule(static)
+				for( int j = 0; j < n; j++ )
+				{
+					int id = bank_ids[j];
+					double p_energy;
+					memcpy(&p_energy, &bank_keys[j], sizeof(double));
+
+					calculate_macro_xs_hint<xs_t, GRID, K>( p_energy, bank_mat[id], in.n_isotopes,
+							in.n_gridpoints, num_nucs, concs,
+							local_energy_grid, local_nuclide_grids, mats,
+							&bank_xs[5 * id], in.grid_type, in.hash_bins, lt, &hint );
+				}
+
+				memcpy(xs, &bank_xs[5 * (n-1)], 5*sizeof(double));
+
+				#ifdef VERIFICATION
+				#pragma omp for schedule(static)
+				for( int j = 0; j < n; j++ )
+				{
+					unsigned int hash = 5381;
+					hash = ((hash << 5) + hash) + (int)bank_energy[j];
+					hash = ((hash << 5) + hash) + (int)bank_mat[j];
+					for(int k = 0; k < 5; k++)
+						hash = ((hash << 5) + hash) + bank_xs[5*j + k];
+					vhash += hash % 1000;
+				}
+				#endif
+			}
+		}
+
+		// Batched XS Lookup Loop
+		// Same lookups as below, handed to calculate_macro_xs_batch
+		// in.batch at a time so their memory accesses overlap
+		else if( in.batch > 0 )
+		{
+			#pragma omp for schedule(guided)
+			for( int b = 0; b < in.lookups; b += in.batch )
+			{
+				int n = in.lookups - b;
+				if( n > in.batch )
+					n = in.batch;
+
+				double p_energy[MAX_BATCH];
+				int mat[MAX_BATCH];
+				double macro_xs_vectors[5 * MAX_BATCH];
+				// Particles are seeded by their particle ID
+				sample_particles( b, n, p_energy, mat );
+
+				calculate_macro_xs_batch<xs_t, GRID, K>( p_energy, mat, n, in.n_isotopes,
+						in.n_gridpoints, num_nucs, concs,
+						local_energy_grid, local_nuclide_grids, mats,
+						macro_xs_vectors, in.grid_type, in.hash_bins, lt );
+
+				memcpy(xs, &macro_xs_vectors[5 * (n-1)], 5*sizeof(double));
+
+				#ifdef VERIFICATION
+				for( int j = 0; j < n; j++ )
+				{
+					unsigned int hash = 5381;
+					hash = ((hash << 5) + hash) + (int)p_energy[j];
+					hash = ((hash << 5) + hash) + (int)mat[j];
+					for(int k = 0; k < 5; k++)
+						hash = ((hash << 5) + hash) + macro_xs_vectors[5*j + k];
+					vhash += hash % 1000;
+				}
+				#endif
+			}
+		}
+
 		// XS Lookup Loop
 		// This loop is independent. Represents lookup events for many particles executed independently in one loop.
 		//     i.e., All iterations can be processed in any order and are not related
+		// The particles' energies and materials are sampled SAMPLE_BLOCK at a time.
+		else
 		#pragma omp for schedule(guided)
-		for( int i = 0; i < in.lookups; i++ )
+		for( int b = 0; b < in.lookups; b += SAMPLE_BLOCK )
 		{
-			// Status text
-			if( INFO && mype == 0 && thread == 0 && i % 2000 == 0 )
-				printf("\rCalculating XS's... (%.0lf%% completed)",
-						(i / ( (double) in.lookups / (double) in.nthreads ))
-						/ (double) in.nthreads * 100.0);
-			// Particles are seeded by their particle ID
-			unsigned long seed = ((unsigned long) i+ (unsigned long)1)* (unsigned long) 13371337;
+			int n = in.lookups - b;
+			if( n > SAMPLE_BLOCK )
+				n = SAMPLE_BLOCK;
+
+			// Randomly pick an energy and material for the particles,
+			// which are seeded by their particle ID
+			double block_energy[SAMPLE_BLOCK];
+			int block_mat[SAMPLE_BLOCK];
+			sample_particles( b, n, block_energy, block_mat );
 
-			// Randomly pick an energy and material for the particle
-			double p_energy = rn(&seed);
-			int mat      = pick_mat(&seed); 
+			for( int j = 0; j < n; j++ )
+			{
+				int i = b + j;
 
-			// debugging
-			//printf("E = %lf mat = %d\n", p_energy, mat);
+				// Status text
+				if( INFO && mype == 0 && thread == 0 && i % 2000 == 0 )
+					printf("\rCalculating XS's... (%.0lf%% completed)",
+							(i / ( (double) in.lookups / (double) in.nthreads ))
+							/ (double) in.nthreads * 100.0);
 
-			double macro_xs_vector[5] = {0};
-			
-			// This returns the macro_xs_vector, but we're not going
-			// to do anything with it in this program, so return value
-			// is written over.
-			calculate_macro_xs( p_energy, mat, in.n_isotopes,
-					in.n_gridpoints, num_nucs, concs,
-					energy_grid, nuclide_grids, mats,
-					macro_xs_vector, in.grid_type, in.hash_bins );
-
-			// Copy results from above function call onto heap
-			// so that compiler cannot optimize function out
-			// (only occurs if -flto flag is used)
-			// This operation is only done to avoid optimizing out
-			// calculate_macro_xs -- we do not care about what is
-			// in the "xs" array
-			memcpy(xs, macro_xs_vector, 5*sizeof(double));
-
-			// Verification hash calculation
-			// This method provides a consistent hash accross
-			// architectures and compilers.
-			#ifdef VERIFICATION
-			
-			unsigned int hash = 5381;
-			hash = ((hash << 5) + hash) + (int)p_energy;
-                	hash = ((hash << 5) + hash) + (int)mat;
-                	for(int k = 0; k < 5; k++)
-                       		hash = ((hash << 5) + hash) + macro_xs_vector[k];
-//			printf("Simulation: hash: %d\n", hash);
-                	vhash += hash % 1000;
-			
-			#endif
+				double p_energy = block_energy[j];
+				int mat      = block_mat[j];
+
+				// debugging
+				//printf("E = %lf mat = %d\n", p_energy, mat);
+
+				double macro_xs_vector[5] = {0};
+
+				// This returns the macro_xs_vector, but we're not going
+				// to do anything with it in this program, so return value
+				// is written over.
+				calculate_macro_xs<xs_t, GRID, K>( p_energy, mat, in.n_isotopes,
+						in.n_gridpoints, num_nucs, concs,
+						local_energy_grid, local_nuclide_grids, mats,
+						macro_xs_vector, in.grid_type, in.hash_bins, lt );
+
+				// Copy results from above function call onto heap
+				// so that compiler cannot optimize function out
+				// (only occurs if -flto flag is used)
+				// This operation is only done to avoid optimizing out
+				// calculate_macro_xs -- we do not care about what is
+				// in the "xs" array
+				memcpy(xs, macro_xs_vector, 5*sizeof(double));
+
+				// Verification hash calculation
+				// This method provides a consistent hash accross
+				// architectures and compilers.
+				#ifdef VERIFICATION
+
+				unsigned int hash = 5381;
+				hash = ((hash << 5) + hash) + (int)p_energy;
+				hash = ((hash << 5) + hash) + (int)mat;
+				for(int k = 0; k < 5; k++)
+					hash = ((hash << 5) + hash) + macro_xs_vector[k];
+				vhash += hash % 1000;
+
+				#endif
+			}
 		}
 
 		// Prints out thread local PAPI counters
@@ -101,18 +326,128 @@ void run_event_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridP
 
 	}
 	*vhash_result = vhash;
+
+	free(bank_energy);
+	free(bank_mat);
+	free(bank_xs);
+	free(bank_keys);
+	free(bank_tmp_keys);
+	free(bank_ids);
+	free(bank_tmp_ids);
+	free(bank_hist);
+	free(bank_tasks);
+}
+
+void run_event_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long * vhash_result, LookupTables * lt)
+{
+	// This is the only place the lookup path branches on the options
+	#define SELECT_KERNEL( xs_t, GRID, K ) \
+		if( is_kernel<xs_t, GRID, K>( in ) ) \
+			return event_based_simulation<xs_t, GRID, K>( in, energy_grid, nuclide_grids, num_nucs, \
+			                                              mats, concs, mype, vhash_result, lt );
+	FOR_EACH_KERNEL( SELECT_KERNEL )
+	#undef SELECT_KERNEL
 }
 
-void run_history_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long long * vhash_result)
+// Runs the history of particle p: its lookups each pick the energy and
+// material of the next one. Returns the particle's verification hash.
+template <typename xs_t, int GRID, int K>
+static unsigned long long simulate_history( Inputs & in, long p, GridPoint * energy_grid,
+                                            NuclideGridPoint ** nuclide_grids, int * num_nucs,
+                                            int ** mats, double ** concs, double * xs,
+                                            LookupTables * lt )
+{
+	unsigned long long vhash = 0;
+
+	// Particles are seeded by their particle ID
+	unsigned long seed = ((unsigned long) p+ (unsigned long)1)* (unsigned long) 13371337;
+
+	// Randomly pick an energy and material for the particle
+	double p_energy = rn(&seed);
+	int mat      = pick_mat(&seed); 
+
+	// XS Lookup Loop
+	// This loop is dependent!
+	// i.e., Next iteration uses data computed in previous iter.
+	int n_lookups = history_length( in.history_lengths, in.lookups, p );
+	for( int i = 0; i < n_lookups; i++ )
+	{
+		// debugging
+		//printf("E = %lf mat = %d\n", p_energy, mat);
+
+		double macro_xs_vector[5] = {0};
+
+		// This returns the macro_xs_vector, but we're not going
+		// to do anything with it in this program, so return value
+		// is written over.
+		calculate_macro_xs<xs_t, GRID, K>( p_energy, mat, in.n_isotopes,
+				in.n_gridpoints, num_nucs, concs,
+				energy_grid, nuclide_grids, mats,
+				macro_xs_vector, in.grid_type, in.hash_bins, lt );
+
+		// Copy results from above function call onto heap
+		// so that compiler cannot optimize function out
+		// (only occurs if -flto flag is used)
+		// This operation is only done to avoid optimizing out
+		// calculate_macro_xs -- we do not care about what is
+		// in the "xs" array
+		memcpy(xs, macro_xs_vector, 5*sizeof(double));
+
+		// Verification hash calculation
+		// This method provides a consistent hash accross
+		// architectures and compilers.
+		#ifdef VERIFICATION
+		char line[256];
+		sprintf(line, "%.5lf %d %.5lf %.5lf %.5lf %.5lf %.5lf",
+				p_energy, mat,
+				macro_xs_vector[0],
+				macro_xs_vector[1],
+				macro_xs_vector[2],
+				macro_xs_vector[3],
+				macro_xs_vector[4]);
+		unsigned long long vhash_local = hash(line, 10000);
+
+		vhash += vhash_local;
+		#endif
+
+		// Randomly pick next energy and material for the particle
+		// Also incorporates results from macro_xs lookup to
+		// enforce loop dependency.
+		// In a real MC app, this dependency is expressed in terms
+		// of branching physics sampling, whereas here we are just
+		// artificially enforcing this dependence based on altering
+		// the seed
+		for( int x = 0; x < 5; x++ )
+			seed += macro_xs_vector[x] * (x+1)*1337*1337;
+
+		p_energy = rn(&seed);
+		mat      = pick_mat(&seed); 
+	}
+
+	return vhash;
+}
+
+template <typename xs_t, int GRID, int K>
+static void history_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long long * vhash_result, LookupTables * lt)
 {
 	if( mype == 0)	
 		printf("Beginning history based simulation...\n");
+
+	// Time each thread spends running histories, and how many it ran
+	double * busy = (double *) calloc( in.nthreads, sizeof(double) );
+	long * histories = (long *) calloc( in.nthreads, sizeof(long) );
+	TaskScheduler sched;
+	if( in.scheduler == SCHED_STEAL )
+		scheduler_init( &sched, in.particles, in.nthreads );
+	double start_time = omp_get_wtime();
+
 	unsigned long long vhash = 0;
 	// OpenMP compiler directives - declaring variables as shared or private
 	// The reduction is only needed when in verification mode.
 	#pragma omp parallel default(none) \
 	shared( in, energy_grid, nuclide_grids, \
-			mats, concs, num_nucs, mype) \
+			mats, concs, num_nucs, mype, lt, \
+			busy, histories, sched) \
 	reduction(+:vhash)
 	{	
 		// Initialize parallel PAPI counters
@@ -130,83 +465,125 @@ void run_history_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGri
 		// Initialize RNG seeds for threads
 		int thread = omp_get_thread_num();
 
+		// Threads read the grids replicated on their NUMA node
+		int node = thread_numa_node( lt, thread, in.nthreads );
+		GridPoint * local_energy_grid = lt->numa_energy_grid ? lt->numa_energy_grid[node] : energy_grid;
+		NuclideGridPoint ** local_nuclide_grids = lt->numa_nuclide_grids ? lt->numa_nuclide_grids[node] : nuclide_grids;
+
+		// Each thread is timed from the start of its loop until it runs
+		// out of particles. The loops do not wait for each other at the end.
+		long thread_histories = 0;
+		double thread_start = omp_get_wtime();
+
+		// Lockstep Particle Loop
+		// Same histories as below, in.lanes particles at a time. Each step
+		// looks up the next XS of every lane with calculate_macro_xs_batch,
+		// so the lanes' independent searches and gathers overlap, then
+		// advances each lane's own seed as below.
+		if( in.lanes > 0 )
+		{
+			#pragma omp for schedule(guided) nowait
+			for( int b = 0; b < in.particles; b += in.lanes )
+			{
+				int n = in.particles - b;
+				if( n > in.lanes )
+					n = in.lanes;
+
+				unsigned long seed[MAX_BATCH];
+				double p_energy[MAX_BATCH];
+				int mat[MAX_BATCH];
+				double macro_xs_vectors[5 * MAX_BATCH];
+				for( int j = 0; j < n; j++ )
+				{
+					// Particles are seeded by their particle ID
+					seed[j] = ((unsigned long) (b+j)+ (unsigned long)1)* (unsigned long) 13371337;
+					p_energy[j] = rn(&seed[j]);
+					mat[j] = pick_mat(&seed[j]);
+				}
+				thread_histories += n;
+
+				// Status text
+				if( INFO && mype == 0 && thread == 0 && b % 100 < n )
+					printf("\rCalculating XS's... (%.0lf%% completed)",
+							(b / ( (double)in.particles / (double) in.nthreads ))
+							/ (double) in.nthreads * 100.0);
+
+				for( int i = 0; i < in.lookups; i++ )
+				{
+					calculate_macro_xs_batch<xs_t, GRID, K>( p_energy, mat, n, in.n_isotopes,
+							in.n_gridpoints, num_nucs, concs,
+							local_energy_grid, local_nuclide_grids, mats,
+							macro_xs_vectors, in.grid_type, in.hash_bins, lt );
+
+					memcpy(xs, &macro_xs_vectors[5 * (n-1)], 5*sizeof(double));
+
+					for( int j = 0; j < n; j++ )
+					{
+						double * macro_xs_vector = &macro_xs_vectors[5 * j];
+
+						#ifdef VERIFICATION
+						char line[256];
+						sprintf(line, "%.5lf %d %.5lf %.5lf %.5lf %.5lf %.5lf",
+								p_energy[j], mat[j],
+								macro_xs_vector[0],
+								macro_xs_vector[1],
+								macro_xs_vector[2],
+								macro_xs_vector[3],
+								macro_xs_vector[4]);
+						vhash += hash(line, 10000);
+						#endif
+
+						for( int x = 0; x < 5; x++ )
+							seed[j] += macro_xs_vector[x] * (x+1)*1337*1337;
+
+						p_energy[j] = rn(&seed[j]);
+						mat[j]      = pick_mat(&seed[j]);
+					}
+				}
+			}
+		}
+
 		// Particle loop 
 		// (independent - can be processed in any order and in parallel)
 		// Only present in History based method (default)
-		#pragma omp for schedule(guided)
-		for( int p = 0; p < in.particles; p++ )
+		// The particles are handed out by the work stealing scheduler, or
+		// by OpenMP.
+		else if( in.scheduler == SCHED_STEAL )
 		{
-			// Particles are seeded by their particle ID
-			unsigned long seed = ((unsigned long) p+ (unsigned long)1)* (unsigned long) 13371337;
+			scheduler_fill( &sched, thread );
+			#pragma omp barrier
 
-			// Randomly pick an energy and material for the particle
-			double p_energy = rn(&seed);
-			int mat      = pick_mat(&seed); 
+			long p;
+			while( ( p = scheduler_next( &sched, thread ) ) >= 0 )
+			{
+				// Status text
+				if( INFO && mype == 0 && thread == 0 && thread_histories % 100 == 0 )
+					printf("\rCalculating XS's... (%.0lf%% completed)",
+							100.0 * ( in.particles - sched.untaken ) / in.particles);
 
+				vhash += simulate_history<xs_t, GRID, K>( in, p, local_energy_grid, local_nuclide_grids,
+				                                          num_nucs, mats, concs, xs, lt );
+				thread_histories++;
+			}
+		}
+		else
+		#pragma omp for schedule(guided) nowait
+		for( int p = 0; p < in.particles; p++ )
+		{
 			// Status text
 			if( INFO && mype == 0 && thread == 0 && p % 100 == 0 )
 				printf("\rCalculating XS's... (%.0lf%% completed)",
 						(p / ( (double)in.particles / (double) in.nthreads ))
 						/ (double) in.nthreads * 100.0);
 
-			// XS Lookup Loop
-			// This loop is dependent!
-			// i.e., Next iteration uses data computed in previous iter.
-			for( int i = 0; i < in.lookups; i++ )
-			{
-				// debugging
-				//printf("E = %lf mat = %d\n", p_energy, mat);
-
-				double macro_xs_vector[5] = {0};
-
-				// This returns the macro_xs_vector, but we're not going
-				// to do anything with it in this program, so return value
-				// is written over.
-				calculate_macro_xs( p_energy, mat, in.n_isotopes,
-						in.n_gridpoints, num_nucs, concs,
-						energy_grid, nuclide_grids, mats,
-						macro_xs_vector, in.grid_type, in.hash_bins );
-
-				// Copy results from above function call onto heap
-				// so that compiler cannot optimize function out
-				// (only occurs if -flto flag is used)
-				// This operation is only done to avoid optimizing out
-				// calculate_macro_xs -- we do not care about what is
-				// in the "xs" array
-				memcpy(xs, macro_xs_vector, 5*sizeof(double));
-
-				// Verification hash calculation
-				// This method provides a consistent hash accross
-				// architectures and compilers.
-				#ifdef VERIFICATION
-				char line[256];
-				sprintf(line, "%.5lf %d %.5lf %.5lf %.5lf %.5lf %.5lf",
-						p_energy, mat,
-						macro_xs_vector[0],
-						macro_xs_vector[1],
-						macro_xs_vector[2],
-						macro_xs_vector[3],
-						macro_xs_vector[4]);
-				unsigned long long vhash_local = hash(line, 10000);
-
-				vhash += vhash_local;
-				#endif
-
-				// Randomly pick next energy and material for the particle
-				// Also incorporates results from macro_xs lookup to
-				// enforce loop dependency.
-				// In a real MC app, this dependency is expressed in terms
-				// of branching physics sampling, whereas here we are just
-				// artificially enforcing this dependence based on altering
-				// the seed
-				for( int x = 0; x < 5; x++ )
-					seed += macro_xs_vector[x] * (x+1)*1337*1337;
-
-				p_energy = rn(&seed);
-				mat      = pick_mat(&seed); 
-			}
+			vhash += simulate_history<xs_t, GRID, K>( in, p, local_energy_grid, local_nuclide_grids,
+			                                          num_nucs, mats, concs, xs, lt );
+			thread_histories++;
 		}
 
+		busy[thread] = omp_get_wtime() - thread_start;
+		histories[thread] = thread_histories;
+
 		// Prints out thread local PAPI counters
 		#ifdef PAPI
 		if( mype == 0 && thread == 0 )
@@ -225,4 +602,170 @@ void run_history_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGri
 
 	}
 	*vhash_result = vhash;
+
+	// How evenly the particles were shared out
+	if( mype == 0 )
+	{
+		long * steals = (long *) calloc( in.nthreads, sizeof(long) );
+		if( in.scheduler == SCHED_STEAL )
+			for( int t = 0; t < in.nthreads; t++ )
+				steals[t] = sched.deques[t].steals;
+		print_thread_times( in.nthreads, omp_get_wtime() - start_time, busy, histories,
+		                    in.scheduler == SCHED_STEAL ? steals : NULL );
+		free(steals);
+	}
+
+	if( in.scheduler == SCHED_STEAL )
+		scheduler_free( &sched );
+	free(busy);
+	free(histories);
+}
+
+void run_history_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long long * vhash_result, LookupTables * lt)
+{
+	#define SELECT_KERNEL( xs_t, GRID, K ) \
+		if( is_kernel<xs_t, GRID, K>( in ) ) \
+			return history_based_simulation<xs_t, GRID, K>( in, energy_grid, nuclide_grids, num_nucs, \
+			                                                mats, concs, mype, vhash_result, lt );
+	FOR_EACH_KERNEL( SELECT_KERNEL )
+	#undef SELECT_KERNEL
+}
+
+// Runs the lookups of in once with the generic kernels (-k generic) and
+// once with the specialised ones on each grid type, and prints the time of
+// each. The unionized grid is only run when it is in's grid type, as it is
+// too large to build on the side; the nuclide grid needs nothing else and
+// the hash grids are built here. The other options apply to the unionized
+// grid, the other grid types run with their defaults.
+void run_kernel_benchmark(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, LookupTables * lt)
+{
+	const char * names[] = { "Unionized", "Nuclide", "Hash", "Log Hash" };
+	double time[4][2] = {{0}};
+	int ran[4] = {0};
+	int agree[4] = {0};
+
+	for( int grid_type = UNIONIZED; grid_type <= LOGHASH; grid_type++ )
+	{
+		Inputs run = in;
+		LookupTables run_lt = *lt;
+		GridPoint * grid = NULL;
+		run.grid_type = grid_type;
+		if( grid_type == UNIONIZED )
+		{
+			if( in.grid_type != UNIONIZED )
+				continue;
+			grid = energy_grid;
+		}
+		else
+		{
+			run.index_type = run_lt.index_type = INDEX_INT;
+			run.search_type = run_lt.search_type = SEARCH_BINARY;
+			run.layout = run_lt.layout = LAYOUT_AOS;
+			if( grid_type == HASH )
+				grid = generate_hash_table( nuclide_grids, in.n_isotopes, in.n_gridpoints, in.hash_bins );
+			else if( grid_type == LOGHASH )
+				grid = generate_loghash_table( nuclide_grids, in.n_isotopes, in.n_gridpoints,
+				                               in.hash_bins, &run_lt );
+		}
+
+		// mype 1 keeps the simulations quiet
+		unsigned long long vhash[2];
+		for( int k = 0; k < 2; k++ )
+		{
+			run.kernels = ( k == 0 ) ? KERNELS_GENERIC : KERNELS_SPECIALIZED;
+			double start = omp_get_wtime();
+			if( in.simulation_method == EVENT_BASED )
+			{
+				unsigned long vhash_event = 0;
+				run_event_based_simulation( run, grid, nuclide_grids, num_nucs, mats, concs, 1,
+				                            &vhash_event, &run_lt );
+				vhash[k] = vhash_event;
+			}
+			else
+			{
+				vhash[k] = 0;
+				run_history_based_simulation( run, grid, nuclide_grids, num_nucs, mats, concs, 1,
+				                              &vhash[k], &run_lt );
+			}
+			time[grid_type][k] = omp_get_wtime() - start;
+		}
+		ran[grid_type] = 1;
+		agree[grid_type] = ( vhash[0] == vhash[1] );
+
+		if( grid_type == HASH || grid_type == LOGHASH )
+		{
+			alignedFree( grid[0].xs_ptrs );
+			free( grid );
+		}
+	}
+
+	printf("\n");
+	border_print();
+	center_print("KERNEL BENCHMARK", 79);
+	border_print();
+	printf("Grid Type      Generic (s)   Specialized (s)   Speedup\n");
+	for( int grid_type = UNIONIZED; grid_type <= LOGHASH; grid_type++ )
+	{
+		if( !ran[grid_type] )
+			continue;
+		printf("%-12s %13.3lf %17.3lf %8.2lfx\n", names[grid_type], time[grid_type][0],
+		       time[grid_type][1], time[grid_type][0] / time[grid_type][1]);
+		if( !agree[grid_type] )
+			printf("ERROR: the %s kernels do not give the same verification hash\n",
+			       names[grid_type]);
+	}
+	border_print();
+}
+
+// Cross-checks the approximate lookup modes (mixed precision, slope grid,
+// macro tables) against double precision interpolation over ERROR_SAMPLES
+// lookups, whatever the simulation method, returning the largest relative
+// difference of any macro XS
+double lookup_max_rel_error(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, LookupTables * lt)
+{
+	LookupTables reference = *lt;
+	reference.interp = INTERP_LERP;
+
+	double max_err = 0;
+	#pragma omp parallel for schedule(guided) reduction(max:max_err)
+	for( int i = 0; i < ERROR_SAMPLES; i++ )
+	{
+		// Particles are seeded by their particle ID
+		unsigned long seed = ((unsigned long) i+ (unsigned long)1)* (unsigned long) 13371337;
+		double p_energy = rn(&seed);
+		int mat      = pick_mat(&seed);
+
+		double approx_xs[5];
+		double ref_xs[5];
+		if( in.tables == TABLES_MACRO )
+			calculate_macro_xs<double, GRID_MACRO>( p_energy, mat, in.n_isotopes,
+					in.n_gridpoints, num_nucs, concs,
+					energy_grid, nuclide_grids, mats,
+					approx_xs, in.grid_type, in.hash_bins, lt );
+		else if( in.precision == PRECISION_MIXED )
+			calculate_macro_xs<float>( p_energy, mat, in.n_isotopes,
+					in.n_gridpoints, num_nucs, concs,
+					energy_grid, nuclide_grids, mats,
+					approx_xs, in.grid_type, in.hash_bins, lt );
+		else
+			calculate_macro_xs( p_energy, mat, in.n_isotopes,
+					in.n_gridpoints, num_nucs, concs,
+					energy_grid, nuclide_grids, mats,
+					approx_xs, in.grid_type, in.hash_bins, lt );
+		calculate_macro_xs( p_energy, mat, in.n_isotopes,
+				in.n_gridpoints, num_nucs, concs,
+				energy_grid, nuclide_grids, mats,
+				ref_xs, in.grid_type, in.hash_bins, &reference );
+
+		for( int k = 0; k < 5; k++ )
+		{
+			if( ref_xs[k] == 0 )
+				continue;
+			double err = fabs( (approx_xs[k] - ref_xs[k]) / ref_xs[k] );
+			if( err > max_err )
+				max_err = err;
+		}
+	}
+
+	return max_err;
 }
@@ -25,6 +25,30 @@ typedef struct{
 	int * xs_ptrs;
 } GridPoint;
 
+// Nuclide grid point with what is needed to interpolate up to the next
+// point: xs = xs + (E - energy) * slope. 88 bytes.
+typedef struct{
+	double energy;
+	double xs[5];    // total, elastic, absorbtion, fission, nu fission
+	double slope[5]; // (next point's xs - xs) / (next point's energy - energy)
+} SlopeGridPoint;
+
+// Nuclide grid point with the XS in single precision, for the mixed
+// precision lookups. The energy stays double for the searches. 28 bytes.
+typedef struct __attribute__((packed)) {
+	double energy;
+	float total_xs;
+	float elastic_xs;
+	float absorbtion_xs;
+	float fission_xs;
+	float nu_fission_xs;
+} FloatGridPoint;
+
+// Grid point type the lookups read XS of precision xs_t from
+template <typename xs_t> struct XSStorage;
+template <> struct XSStorage<double> { typedef NuclideGridPoint point; };
+template <> struct XSStorage<float> { typedef FloatGridPoint point; };
+
 typedef struct{
 	int nthreads;
 	long n_isotopes;
@@ -35,22 +59,283 @@ typedef struct{
 	int hash_bins;
 	int particles;
 	int simulation_method;
+	int index_type; // Encoding of the unionized grid xs_ptrs
+	int device;
+	int rng; // Generator used for the nuclide grids and concentrations
+	int search_type; // Search algorithm used on the unionized grid
+	int batch; // Event based lookups per calculate_macro_xs_batch call (0: unbatched)
+	int lanes; // History based particles advanced in lockstep (0: one at a time)
+	int scheduler; // How the history based particles are shared out to the threads
+	int history_lengths; // Whether every history has in.lookups lookups
+	int layout; // Nuclide grid layout used by the unionized grid lookups
+	int interp; // How the micro XS are interpolated
+	int precision; // Precision the XS and concentrations are stored in
+	int kernels; // Whether the lookups are specialised on the grid type
+	int bank; // Event based lookups per energy sorted bank (0: unsorted)
+	int queue; // How the lookups of each bank are queued
+	int tables; // Whether the macro XS are looked up from pre-summed tables
+	int numa; // NUMA placement of the XS data
+	int numa_nodes; // Simulated NUMA nodes (0: the machine's)
+	int pages; // Page size backing the grids
 } Inputs;
 
+// Work stealing deque of one thread (Chase-Lev, with a fixed capacity).
+// The owner pushes and pops at the bottom, thieves steal from the top.
+// top and bottom are kept on separate cache lines.
+typedef struct __attribute__((aligned(64))){
+	long top;
+	char pad[56];
+	long bottom;
+	long capacity;
+	int * tasks;         // [index % capacity]
+	unsigned long rng;   // owner's victim picks
+	long steals;         // owner's successful steals
+} TaskDeque;
+
+typedef struct{
+	int nthreads;
+	long n_tasks;
+	long untaken;        // tasks not yet popped or stolen
+	TaskDeque * deques;
+} TaskScheduler;
+
+// Header of the XS_data.dat binary file. It is followed by page aligned
+// sections: the nuclide grids, then for the unionized grid its energies,
+// then for the INDEX_INT encoding its xs_ptrs, then the material
+// concentrations, which are drawn from the same rand() stream as the
+// grids. Offsets are in bytes.
+typedef struct{
+	char magic[8];        // BINARY_MAGIC
+	int version;          // BINARY_VERSION
+	int grid_type;
+	int index_type;
+	int point_bytes;      // sizeof(NuclideGridPoint)
+	long n_isotopes;
+	long n_gridpoints;
+	long grid_offset;     // NuclideGridPoint [n_isotopes * n_gridpoints]
+	long energy_offset;   // double [n_isotopes * n_gridpoints], or 0
+	long index_offset;    // int [(n_isotopes * n_gridpoints) * n_isotopes], or 0
+	long concs_offset;    // double [n_concs], concs of each material in turn
+	long n_concs;
+	long file_bytes;
+	unsigned long checksum; // of the header and every section, see binary_checksum
+} BinaryHeader;
+
+// Macroscopic XS of one material, summed over its nuclides at the union
+// of their grid energies
+typedef struct{
+	long n;
+	double * energy; // [n]
+	double * xs;     // the five macro XS at each energy, [5 * i + k]
+} MacroTable;
+
+// Optional tables built during initialization for use by the lookup
+// functions. Members that are not in use are left NULL.
+typedef struct{
+	int index_type;
+	int pages;                // page size backing the unionized grid index
+	unsigned short * xs_u16;  // INDEX_SHORT: xs_ptrs, [row * n_isotopes + nuc]
+	int * xs_base;            // INDEX_DELTA: xs_ptrs of the first row of each block
+	unsigned char * xs_delta; // INDEX_DELTA: xs_ptrs - xs_base, [row * n_isotopes + nuc]
+	double loghash_log_min;   // LOGHASH: log of the first bin's lower energy
+	double loghash_inv_dlog;  // LOGHASH: bins per unit of log(energy)
+	int search_type;
+	double * eyt_energy;      // SEARCH_EYTZINGER: UEG energies in BFS order, [1..n]
+	int * eyt_index;          // SEARCH_EYTZINGER: UEG index of each eyt_energy
+	double * kary_energy;     // SEARCH_KARY: UEG energies, KARY_B per tree node
+	int * kary_index;         // SEARCH_KARY: UEG index of each kary_energy
+	long kary_nodes;
+	long (*kary_node_search)( double * keys, double quarry ); // ISA specific
+	long bsc_l1_n;            // SEARCH_BSCACHE: L1 resident samples of the L2 table
+	double * bsc_l1_energy;
+	int * bsc_l1_index;       // position of each L1 sample in the L2 table
+	long bsc_l2_n;            // SEARCH_BSCACHE: L2 resident samples of the UEG
+	double * bsc_l2_energy;
+	int * bsc_l2_index;       // UEG index of each L2 sample
+	int layout;
+	double * simd_energy;     // LAYOUT_SOA/SIMD: nuclide grid energies, [(nuc * n_gridpoints + point) * simd_stride]
+	double * simd_xs[5];      // LAYOUT_SOA/SIMD: the five XS channels, indexed as simd_energy
+	long simd_stride;         // doubles between consecutive grid points
+	int simd_isa;             // LAYOUT_SOA/SIMD: widest SIMD the CPU supports
+	int interp;
+	SlopeGridPoint * slope_grid; // INTERP_SLOPE: [nuc * n_gridpoints + point]
+	FloatGridPoint * float_grid; // PRECISION_MIXED: [nuc * n_gridpoints + point]
+	float ** float_concs;        // PRECISION_MIXED: concs in single precision
+	int ** mat_xs;            // INDEX_MATERIAL: xs_ptrs of each material's nuclides,
+	                          // mat_xs[mat][row * num_nucs[mat] + j] for nuclide mats[mat][j]
+	int * mat_num_nucs;       // INDEX_MATERIAL: num_nucs and mats the index is built for
+	int ** mat_nucs;
+	MacroTable * macro_tables; // TABLES_MACRO: one per material
+	int numa_nodes;           // NUMA_REPLICATE: nodes holding a replica
+	int numa_fake;            // the nodes are simulated, threads are split evenly over them
+	GridPoint ** numa_energy_grid;           // NUMA_REPLICATE: energy grid of each node
+	NuclideGridPoint *** numa_nuclide_grids; // NUMA_REPLICATE: nuclide grids of each node
+} LookupTables;
+
 #define UNIONIZED 0
 #define NUCLIDE 1
 #define HASH 2
+#define LOGHASH 3
+
+// Template argument for lookups that read the grid type at run time
+#define GRID_ANY -1
+
+// Template argument for lookups from the material macro tables, which
+// do not use the grids
+#define GRID_MACRO -2
+
+// Template argument for lookups that read the index type, unionized grid
+// search, nuclide grid layout and interpolation from LookupTables at run
+// time. Otherwise the kernel is KERNEL( index, search, layout, interp ) and
+// they fold away.
+#define KERNEL_ANY -1
+#define KERNEL( index, search, layout, interp ) \
+	( (index) | (search) << 2 | (layout) << 4 | (interp) << 6 )
+#define KERNEL_INDEX( K, lt )  ( (K) == KERNEL_ANY ? (lt)->index_type : (K) & 3 )
+#define KERNEL_SEARCH( K, lt ) ( (K) == KERNEL_ANY ? (lt)->search_type : (K) >> 2 & 3 )
+#define KERNEL_LAYOUT( K, lt ) ( (K) == KERNEL_ANY ? (lt)->layout : (K) >> 4 & 3 )
+#define KERNEL_INTERP( K, lt ) ( (K) == KERNEL_ANY ? (lt)->interp : (K) >> 6 & 1 )
+
+// Calls X( xs_t, GRID, K ) for every lookup kernel that is compiled: each
+// valid combination of options read_CLI allows, then the generic kernels
+// and the macro tables. The grids other than the unionized one only use
+// the int index, binary search and array of structs kernels.
+#define FOR_EACH_UNIONIZED_SEARCH( X, xs_t, index, layout, interp ) \
+	X( xs_t, UNIONIZED, KERNEL( index, SEARCH_BINARY, layout, interp ) ) \
+	X( xs_t, UNIONIZED, KERNEL( index, SEARCH_EYTZINGER, layout, interp ) ) \
+	X( xs_t, UNIONIZED, KERNEL( index, SEARCH_KARY, layout, interp ) ) \
+	X( xs_t, UNIONIZED, KERNEL( index, SEARCH_BSCACHE, layout, interp ) )
+#define FOR_EACH_UNIONIZED_INDEX( X, xs_t, layout, interp ) \
+	FOR_EACH_UNIONIZED_SEARCH( X, xs_t, INDEX_INT, layout, interp ) \
+	FOR_EACH_UNIONIZED_SEARCH( X, xs_t, INDEX_SHORT, layout, interp ) \
+	FOR_EACH_UNIONIZED_SEARCH( X, xs_t, INDEX_DELTA, layout, interp )
+#define FOR_EACH_GRID_KERNEL( X, xs_t, interp ) \
+	FOR_EACH_UNIONIZED_INDEX( X, xs_t, LAYOUT_AOS, interp ) \
+	FOR_EACH_UNIONIZED_SEARCH( X, xs_t, INDEX_MATERIAL, LAYOUT_AOS, interp ) \
+	X( xs_t, NUCLIDE, KERNEL( INDEX_INT, SEARCH_BINARY, LAYOUT_AOS, interp ) ) \
+	X( xs_t, HASH, KERNEL( INDEX_INT, SEARCH_BINARY, LAYOUT_AOS, interp ) ) \
+	X( xs_t, LOGHASH, KERNEL( INDEX_INT, SEARCH_BINARY, LAYOUT_AOS, interp ) )
+#define FOR_EACH_KERNEL( X ) \
+	FOR_EACH_GRID_KERNEL( X, double, INTERP_LERP ) \
+	FOR_EACH_GRID_KERNEL( X, double, INTERP_SLOPE ) \
+	FOR_EACH_UNIONIZED_INDEX( X, double, LAYOUT_SOA, INTERP_LERP ) \
+	FOR_EACH_UNIONIZED_INDEX( X, double, LAYOUT_SIMD, INTERP_LERP ) \
+	FOR_EACH_GRID_KERNEL( X, float, INTERP_LERP ) \
+	X( double, GRID_ANY, KERNEL_ANY ) \
+	X( float, GRID_ANY, KERNEL_ANY ) \
+	X( double, GRID_MACRO, KERNEL_ANY )
+
+// Lookups lookup_max_rel_error compares the approximate modes over
+#define ERROR_SAMPLES 1000000
 
 #define HISTORY_BASED 1
 #define EVENT_BASED 2
 
+#define INDEX_INT 0
+#define INDEX_SHORT 1
+#define INDEX_DELTA 2
+#define INDEX_MATERIAL 3
+
+// Rows of the unionized grid per base + delta block. The xs_ptrs of a
+// nuclide advance by at most one gridpoint per unionized grid row, so
+// the offsets from the first row of a block always fit in 8 bits.
+#define DELTA_BLOCK 256
+
+#define FPGA 0
+#define HOST 1
+
+#define RNG_RAND 0
+#define RNG_COUNTER 1
+
+#define SEARCH_BINARY 0
+#define SEARCH_EYTZINGER 1
+#define SEARCH_KARY 2
+#define SEARCH_BSCACHE 3
+
+#define LAYOUT_AOS 0
+#define LAYOUT_SOA 1
+#define LAYOUT_SIMD 2
+
+#define INTERP_LERP 0
+#define INTERP_SLOPE 1
+
+#define KERNELS_SPECIALIZED 0
+#define KERNELS_GENERIC 1
+#define KERNELS_BENCH 2
+
+#define TABLES_NONE 0
+#define TABLES_MACRO 1
+
+#define SCHED_OMP 0
+#define SCHED_STEAL 1
+
+#define HISTORY_FIXED 0
+#define HISTORY_GEOMETRIC 1
+
+// rn_counter stream the geometric history lengths are drawn from
+#define HISTORY_LENGTH_SEED 0x4C656E677468UL
+
+#define PAGES_NONE 0
+#define PAGES_THP 1
+#define PAGES_HUGETLB 2
+
+// Huge page size, and the most live huge_malloc allocations
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define MAX_HUGE_ALLOCS 256
+
+// XS_data.dat format, and the alignment of its sections
+#define BINARY_MAGIC "XSBENCH"
+#define BINARY_VERSION 2
+#define BINARY_ALIGN 4096L
+// Bytes of the sections hashed as one block by the checksum
+#define BINARY_HASH_BLOCK ( 1L << 20 )
+
+#define NUMA_NONE 0
+#define NUMA_INTERLEAVE 1
+#define NUMA_REPLICATE 2
+
+// place_numa_memory node that interleaves the pages over all nodes
+#define NUMA_ALL_NODES -1
+
+#define QUEUE_NONE 0
+#define QUEUE_MATERIAL 1
+
+#define PRECISION_DOUBLE 0
+#define PRECISION_MIXED 1
+
+#define ISA_SCALAR 0
+#define ISA_AVX2 1
+#define ISA_AVX512 2
+
+// Most lookups calculate_macro_xs_batch takes per call
+#define MAX_BATCH 64
+
+// Particles sample_particles is called with by the event based loop
+#define SAMPLE_BLOCK 64
+
+// Digit size of the event bank radix sort
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// Materials in the H-M benchmark
+#define N_MATERIALS 12
+
+// Material queue tasks hold about this many micro XS lookups, and
+// materials with more nuclides than QUEUE_NUCLIDE_MAJOR are looked up
+// nuclide by nuclide
+#define QUEUE_TASK_WORK 8192
+#define QUEUE_NUCLIDE_MAJOR 64
+
+// Keys per k-ary search tree node (one cache line of doubles)
+#define KARY_B 8
+
 // Function Prototypes
 void logo(int version);
 void center_print(const char *s, int width);
 void border_print(void);
 void fancy_int(long a);
 
-NuclideGridPoint ** gpmatrix(size_t m, size_t n);
+NuclideGridPoint ** gpmatrix(size_t m, size_t n, int pages);
 
 void gpmatrix_free( NuclideGridPoint ** M );
 
@@ -64,25 +349,69 @@ void generate_grids( NuclideGridPoint ** nuclide_grids,
 void generate_grids_v( NuclideGridPoint ** nuclide_grids,
                      long n_isotopes, long n_gridpoints );
 */
+void generate_grids_counter( NuclideGridPoint ** nuclide_grids,
+                     long n_isotopes, long n_gridpoints, unsigned long seed );
 void sort_nuclide_grids( NuclideGridPoint ** nuclide_grids, long n_isotopes,
                          long n_gridpoints );
 
 GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
-                                  NuclideGridPoint ** nuclide_grids);
+                                  NuclideGridPoint ** nuclide_grids, int index_type, int pages );
+
+void generate_eytzinger_grid( GridPoint * energy_grid, long n, LookupTables * lt );
+void generate_kary_grid( GridPoint * energy_grid, long n, LookupTables * lt );
+void generate_bscache( GridPoint * energy_grid, long n, LookupTables * lt );
+void generate_float_grid( NuclideGridPoint ** nuclide_grids, long n_isotopes,
+                          long n_gridpoints, LookupTables * lt );
+void generate_slope_grid( NuclideGridPoint ** nuclide_grids, long n_isotopes,
+                          long n_gridpoints, LookupTables * lt );
+void generate_nuclide_simd( NuclideGridPoint ** nuclide_grids, long n_isotopes,
+                            long n_gridpoints, int layout, LookupTables * lt );
+void generate_macro_tables( NuclideGridPoint ** nuclide_grids, long n_gridpoints,
+                            int * num_nucs, int ** mats, double ** concs,
+                            LookupTables * lt );
+
+void generate_numa_placement( Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids,
+                              LookupTables * lt );
 
 void initialization_do_not_profile_set_grid_ptrs( GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids,
-                    long n_isotopes, long n_gridpoints );
+                    long n_isotopes, long n_gridpoints, LookupTables * lt );
 
+template <typename xs_t, int GRID, int K>
 void calculate_micro_xs(   double p_energy, int nuc, long n_isotopes,
                            long n_gridpoints, GridPoint *energy_grid, NuclideGridPoint **nuclide_grids,
-                           long idx, double *xs_vector, int grid_type, int hash_bins );
+                           long idx, xs_t *xs_vector, int grid_type, int hash_bins,
+                           LookupTables *lt );
+template <typename xs_t = double, int GRID = GRID_ANY, int K = KERNEL_ANY>
 void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
                          long n_gridpoints, int *num_nucs,
                          double **concs,
                          GridPoint *energy_grid,
                          NuclideGridPoint **nuclide_grids,
                          int **mats,
-                         double *macro_xs_vector, int grid_type, int hash_bins );
+                         double *macro_xs_vector, int grid_type, int hash_bins,
+                         LookupTables *lt );
+template <typename xs_t = double, int GRID = GRID_ANY, int K = KERNEL_ANY>
+void calculate_macro_xs_batch( double * p_energy, int * mat, int n,
+                               long n_isotopes, long n_gridpoints,
+                               int * num_nucs, double ** concs,
+                               GridPoint * energy_grid,
+                               NuclideGridPoint ** nuclide_grids, int ** mats,
+                               double * macro_xs_vectors, int grid_type, int hash_bins,
+                               LookupTables * lt );
+template <typename xs_t = double, int GRID = GRID_ANY, int K = KERNEL_ANY>
+void calculate_macro_xs_hint( double p_energy, int mat, long n_isotopes,
+                              long n_gridpoints, int * num_nucs,
+                              double ** concs, GridPoint * energy_grid,
+                              NuclideGridPoint ** nuclide_grids, int ** mats,
+                              double * macro_xs_vector, int grid_type, int hash_bins,
+                              LookupTables * lt, long * hint );
+template <typename xs_t = double, int GRID = GRID_ANY, int K = KERNEL_ANY>
+void calculate_macro_xs_queue( const int * ids, int n, const double * p_energy, int mat,
+                               long n_isotopes, long n_gridpoints, int * num_nucs,
+                               double ** concs, GridPoint * energy_grid,
+                               NuclideGridPoint ** nuclide_grids, int ** mats,
+                               double * macro_xs_vectors, int grid_type, int hash_bins,
+                               LookupTables * lt, long * hint );
 
 /* 
 // float
@@ -99,14 +428,28 @@ void calculate_macro_xs( double p_energy, int mat, long n_isotopes,
 */
 
 long grid_search( long n, double quarry, GridPoint * A);
-long grid_search_nuclide( long n, double quarry, NuclideGridPoint * A, long low, long high);
+long grid_search_hint( long n, double quarry, GridPoint * A, long hint );
+long grid_search_eytzinger( long n, double quarry, double * eyt_energy, int * eyt_index );
+long grid_search_kary( long n, double quarry, LookupTables * lt );
+long grid_search_bscache( long n, double quarry, GridPoint * A, LookupTables * lt );
+void select_kary_node_search( LookupTables * lt );
+void select_simd_isa( LookupTables * lt );
+template <typename point_t>
+long grid_search_nuclide( long n, double quarry, const point_t * A, long low, long high);
 
 int * load_num_nucs(long n_isotopes);
 int ** load_mats( int * num_nucs, long n_isotopes );
 double ** load_concs( int * num_nucs );
 //double ** load_concs_v( int * num_nucs );
+double ** load_concs_counter( int * num_nucs, unsigned long seed );
+double ** load_concs_binary( int * num_nucs, double * concs_data );
+float ** load_concs_float( int * num_nucs, double ** concs );
 int pick_mat(unsigned long * seed);
+int history_length( int history_lengths, int mean, long p );
+long total_history_lookups( Inputs in );
+void sample_particles( long first, int n, double * p_energy, int * mat );
 double rn(unsigned long * seed);
+double rn_counter(unsigned long seed, unsigned long counter);
 int rn_int(unsigned long * seed);
 void counter_stop( int * eventset, int num_papi_events );
 void counter_init( int * eventset, int * num_papi_events );
@@ -120,26 +463,50 @@ void print_CLI_error(void);
 double round_double( double input );
 unsigned int hash(char *str, int nbins);
 size_t estimate_mem_usage( Inputs in );
+void * huge_malloc( size_t bytes, int pages );
+void huge_free( void * ptr );
+void report_huge_pages( void );
+int count_numa_nodes( int fake_nodes );
+void place_numa_memory( void * ptr, size_t bytes, int node );
+int thread_numa_node( LookupTables * lt, int thread, int nthreads );
+void scheduler_init( TaskScheduler * s, long n_tasks, int nthreads );
+void scheduler_fill( TaskScheduler * s, int thread );
+long scheduler_next( TaskScheduler * s, int thread );
+void scheduler_free( TaskScheduler * s );
+void sort_event_bank( long n, unsigned long * keys, int * ids,
+                      unsigned long * tmp_keys, int * tmp_ids, long * hist );
 void print_inputs(Inputs in, int nprocs, int version);
 void print_results( Inputs in, int mype, double runtime, int nprocs, unsigned long long vhash );
-void binary_dump(long n_isotopes, long n_gridpoints, NuclideGridPoint ** nuclide_grids, GridPoint * energy_grid, int grid_type);
-void binary_read(long n_isotopes, long n_gridpoints, NuclideGridPoint ** nuclide_grids, GridPoint * energy_grid, int grid_type);
+void print_thread_times( int nthreads, double runtime, double * busy, long * histories, long * steals );
+void binary_dump( Inputs in, NuclideGridPoint ** nuclide_grids, GridPoint * energy_grid,
+                  int * num_nucs, double ** concs );
+NuclideGridPoint ** binary_read( Inputs in, GridPoint ** energy_grid, double ** concs_data );
 
 GridPoint * generate_hash_table( NuclideGridPoint ** nuclide_grids,
                           long n_isotopes, long n_gridpoints, long M );
+GridPoint * generate_loghash_table( NuclideGridPoint ** nuclide_grids,
+                          long n_isotopes, long n_gridpoints, long M,
+                          LookupTables * lt );
 
 void initialization_do_not_profile_set_hash( GridPoint *energy_grid, NuclideGridPoint **nuclide_grids,
                     long n_isotopes, long n_gridpoints );
 
-void run_event_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long * vhash_result);
+void run_event_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long * vhash_result, LookupTables * lt);
+void run_history_based_simulation(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, int mype, unsigned long long * vhash_result, LookupTables * lt);
+void run_kernel_benchmark(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, LookupTables * lt);
+double lookup_max_rel_error(Inputs in, GridPoint * energy_grid, NuclideGridPoint ** nuclide_grids, int * num_nucs, int ** mats, double ** concs, LookupTables * lt);
 
 bool init();
 void cleanup();
-void run_simulation(Inputs in, double *energy, int *energy_grid_xs,
+void run_simulation(Inputs in, double *energy, void *energy_grid_xs,
 					GridPoint *energy_grid,
 					NuclideGridPoint **nuclide_grids,
 					int *num_nucs, int **mats, double **concs, 
-					unsigned long *vhash_result);
+					unsigned long *vhash_result, LookupTables *lt);
+void run_host_simulation(Inputs in, GridPoint *energy_grid,
+					NuclideGridPoint **nuclide_grids,
+					int *num_nucs, int **mats, double **concs,
+					LookupTables *lt);
 
 void run_simulation_v2(Inputs in, GridPoint_Array *energy_grid_array,
           GridPoint *energy_grid,
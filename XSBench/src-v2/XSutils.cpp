@@ -1,12 +1,135 @@
 #include "XSbench_header.h"
 #include "AOCLUtils/aocl_utils.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef NUMA
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#endif
 using namespace aocl_utils;
-// Allocates nuclide matrix
-NuclideGridPoint ** gpmatrix(size_t m, size_t n)
+
+// Allocations made by huge_malloc, for huge_free and report_huge_pages
+typedef struct{
+	void * ptr;
+	size_t bytes;
+	int hugetlb; // mapped from the hugetlbfs pool, rather than THP
+} HugeAlloc;
+static HugeAlloc huge_allocs[MAX_HUGE_ALLOCS];
+static int n_huge_allocs = 0;
+
+// Allocates a large table on huge pages. PAGES_HUGETLB maps the pages
+// from the hugetlbfs pool, falling back to PAGES_THP when the pool is
+// too small. PAGES_THP asks for transparent huge pages on a 2 MB aligned
+// allocation, which the kernel may or may not grant as it is touched.
+// PAGES_NONE is a plain alignedMalloc. Free with huge_free.
+void * huge_malloc( size_t bytes, int pages )
+{
+	if( pages == PAGES_NONE || n_huge_allocs == MAX_HUGE_ALLOCS )
+		return alignedMalloc( bytes );
+
+	size_t len = ( bytes + HUGE_PAGE_SIZE - 1 ) & ~( HUGE_PAGE_SIZE - 1 );
+	void * ptr = NULL;
+	int hugetlb = 0;
+
+	if( pages == PAGES_HUGETLB )
+	{
+		ptr = mmap( NULL, len, PROT_READ | PROT_WRITE,
+		            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		if( ptr == MAP_FAILED )
+			ptr = NULL;
+		else
+			hugetlb = 1;
+	}
+
+	if( ptr == NULL )
+	{
+		if( posix_memalign( &ptr, HUGE_PAGE_SIZE, len ) != 0 )
+			return NULL;
+		madvise( ptr, len, MADV_HUGEPAGE );
+	}
+
+	huge_allocs[n_huge_allocs].ptr = ptr;
+	huge_allocs[n_huge_allocs].bytes = len;
+	huge_allocs[n_huge_allocs].hugetlb = hugetlb;
+	n_huge_allocs++;
+
+	return ptr;
+}
+
+void huge_free( void * ptr )
+{
+	for( int i = 0; i < n_huge_allocs; i++ )
+		if( huge_allocs[i].ptr == ptr )
+		{
+			if( huge_allocs[i].hugetlb )
+				munmap( ptr, huge_allocs[i].bytes );
+			else
+				free( ptr );
+			huge_allocs[i] = huge_allocs[--n_huge_allocs];
+			return;
+		}
+	alignedFree( ptr );
+}
+
+// Prints how much of the huge_malloc allocations is backed by huge pages.
+// hugetlbfs mappings are huge throughout. THP backing is read from the
+// AnonHugePages of the mappings in /proc/self/smaps, so it is only known
+// for the pages touched so far.
+void report_huge_pages( void )
+{
+	if( n_huge_allocs == 0 )
+		return;
+
+	size_t total = 0, hugetlb = 0, thp = 0;
+	for( int i = 0; i < n_huge_allocs; i++ )
+	{
+		total += huge_allocs[i].bytes;
+		if( huge_allocs[i].hugetlb )
+			hugetlb += huge_allocs[i].bytes;
+	}
+
+	FILE * fp = fopen( "/proc/self/smaps", "r" );
+	if( fp != NULL )
+	{
+		char line[256];
+		unsigned long start = 0, end = 0;
+		size_t overlap = 0;
+		while( fgets( line, sizeof(line), fp ) != NULL )
+		{
+			unsigned long a, b, kb;
+			if( sscanf( line, "%lx-%lx ", &a, &b ) == 2 )
+			{
+				// A new mapping: find how much of it the THP allocations cover
+				start = a;
+				end = b;
+				overlap = 0;
+				for( int i = 0; i < n_huge_allocs; i++ )
+				{
+					unsigned long lo = (unsigned long) huge_allocs[i].ptr;
+					unsigned long hi = lo + huge_allocs[i].bytes;
+					if( !huge_allocs[i].hugetlb && lo < end && hi > start )
+						overlap += ( hi < end ? hi : end ) - ( lo > start ? lo : start );
+				}
+			}
+			else if( overlap > 0 && sscanf( line, "AnonHugePages: %lu kB", &kb ) == 1 )
+				thp += ( kb * 1024 < overlap ) ? kb * 1024 : overlap;
+		}
+		fclose( fp );
+	}
+
+	printf("Huge pages: %.1f of %.1f MB (%.0f%%) on 2 MB pages, %ld hugetlbfs and %ld THP\n",
+	       ( hugetlb + thp ) / 1048576.0, total / 1048576.0, 100.0 * ( hugetlb + thp ) / total,
+	       (long) ( hugetlb / HUGE_PAGE_SIZE ), (long) ( thp / HUGE_PAGE_SIZE ));
+}
+
+// Allocates nuclide matrix, with the grids on the given pages
+NuclideGridPoint ** gpmatrix(size_t m, size_t n, int pages)
 {
 	int i,j;
-	NuclideGridPoint * full = (NuclideGridPoint *) alignedMalloc( m * n *
-	                          sizeof( NuclideGridPoint ) );
+	NuclideGridPoint * full = (NuclideGridPoint *) huge_malloc( m * n *
+	                          sizeof( NuclideGridPoint ), pages );
 	NuclideGridPoint ** M = (NuclideGridPoint **) alignedMalloc( m *
 	                          sizeof(NuclideGridPoint *) );
 
@@ -20,8 +143,8 @@ NuclideGridPoint ** gpmatrix(size_t m, size_t n)
 // Frees nuclide matrix
 void gpmatrix_free( NuclideGridPoint ** M )
 {
-	free( *M );
-	free( M );
+	huge_free( *M );
+	alignedFree( M );
 }
 
 // Compare function for two grid points. Used for sorting during init
@@ -63,6 +186,19 @@ double rn_v(void)
 	return ret;
 }
 
+// Counter based RNG used for parallel initialization.
+// Returns the "counter"th output of a SplitMix64 stream started at "seed",
+// as a double in [0,1). As each value only depends on its counter, data
+// can be generated by any number of threads in any order.
+double rn_counter(unsigned long seed, unsigned long counter)
+{
+	unsigned long z = seed + (counter + 1) * 0x9E3779B97F4A7C15UL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+	z = z ^ (z >> 31);
+	return (double) (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
 unsigned int hash(char *str, int nbins)
 {
 	unsigned int hash = 5381;
@@ -81,65 +217,600 @@ size_t estimate_mem_usage( Inputs in )
 	size_t size_GridPoint      = sizeof(GridPoint) + in.n_isotopes*sizeof(int);
 	size_t size_UEG            = in.n_isotopes*in.n_gridpoints * size_GridPoint;
 	size_t size_hash_grid      = in.hash_bins * size_GridPoint;
+
+	// Compact encodings replace the int xs_ptrs arrays
+	if( in.index_type == INDEX_SHORT )
+		size_UEG = in.n_isotopes*in.n_gridpoints * (sizeof(GridPoint) + in.n_isotopes*sizeof(unsigned short));
+	else if( in.index_type == INDEX_DELTA )
+		size_UEG = in.n_isotopes*in.n_gridpoints * (sizeof(GridPoint) + in.n_isotopes*sizeof(unsigned char))
+		         + (in.n_isotopes*in.n_gridpoints / DELTA_BLOCK + 1) * in.n_isotopes*sizeof(int);
+	// One row per material, holding only that material's xs_ptrs
+	if( in.index_type == INDEX_MATERIAL )
+	{
+		int * num_nucs = load_num_nucs( in.n_isotopes );
+		size_t mat_nucs = 0;
+		for( int m = 0; m < N_MATERIALS; m++ )
+			mat_nucs += num_nucs[m];
+		free( num_nucs );
+		size_UEG = in.n_isotopes*in.n_gridpoints * (sizeof(GridPoint) + mat_nucs*sizeof(int));
+	}
+	// Macro tables, one energy and five XS per point of each material's
+	// union grid (at most all of its nuclides' points)
+	size_t size_macro_tables = 0;
+	if( in.tables == TABLES_MACRO )
+	{
+		int * num_nucs = load_num_nucs( in.n_isotopes );
+		for( int m = 0; m < N_MATERIALS; m++ )
+			size_macro_tables += num_nucs[m] * in.n_gridpoints * 6 * sizeof(double);
+		free( num_nucs );
+	}
 	size_t memtotal;
 
+	// Eytzinger ordered copy of the UEG energies, with their UEG indices
+	if( in.search_type == SEARCH_EYTZINGER )
+		size_UEG += in.n_isotopes*in.n_gridpoints * (sizeof(double) + sizeof(int));
+
+	// K-ary search tree of the UEG energies, with their UEG indices
+	if( in.search_type == SEARCH_KARY )
+		size_UEG += (in.n_isotopes*in.n_gridpoints + KARY_B) * (sizeof(double) + sizeof(int));
+
+	// Mixed precision copy of the nuclide grids
+	if( in.precision == PRECISION_MIXED )
+		all_nuclide_grids += in.n_isotopes*in.n_gridpoints * sizeof(FloatGridPoint);
+
+	// Slope grid copy of the nuclide grids
+	if( in.interp == INTERP_SLOPE )
+		all_nuclide_grids += in.n_isotopes*in.n_gridpoints * sizeof(SlopeGridPoint);
+
+	// Structure of arrays copy of the nuclide grids
+	if( in.layout == LAYOUT_SOA )
+		size_UEG += in.n_isotopes*in.n_gridpoints * 6 * sizeof(double);
+
 	if( in.grid_type == UNIONIZED )
 		memtotal          = all_nuclide_grids + size_UEG;
 	else if( in.grid_type == NUCLIDE )
 		memtotal          = all_nuclide_grids;
-	else
+	else if( in.grid_type == HASH )
 		memtotal          = all_nuclide_grids + size_hash_grid;
+	else
+		memtotal          = all_nuclide_grids + in.hash_bins * (sizeof(GridPoint) + 2*in.n_isotopes*sizeof(int));
+
+	// Every node past the first holds its own copy of the nuclide grids
+	// and of the energy grid with its int xs_ptrs
+	if( in.numa == NUMA_REPLICATE )
+	{
+		size_t size_replica = in.n_isotopes * single_nuclide_grid;
+		if( in.grid_type == UNIONIZED )
+			size_replica += in.n_isotopes*in.n_gridpoints * ( in.index_type == INDEX_INT ?
+			                size_GridPoint : sizeof(GridPoint) );
+		else if( in.grid_type == HASH )
+			size_replica += size_hash_grid;
+		else if( in.grid_type == LOGHASH )
+			size_replica += in.hash_bins * (sizeof(GridPoint) + 2*in.n_isotopes*sizeof(int));
+		memtotal     += ( count_numa_nodes( in.numa_nodes ) - 1 ) * size_replica;
+	}
 
+	memtotal         += size_macro_tables;
 	memtotal          = memtotal / 1048576;
 	return memtotal;
 }
 
-void binary_dump(long n_isotopes, long n_gridpoints, NuclideGridPoint ** nuclide_grids, GridPoint * energy_grid, int grid_type)
+// NUMA nodes the XS data is placed on: the simulated count if one is
+// given, otherwise the machine's. Without libnuma there is one node.
+int count_numa_nodes( int fake_nodes )
+{
+	if( fake_nodes > 0 )
+		return fake_nodes;
+	#ifdef NUMA
+	if( numa_available() >= 0 )
+		return numa_num_configured_nodes();
+	#endif
+	return 1;
+}
+
+// Binds the pages of [ptr, ptr + bytes) to a node, or interleaves them
+// over all nodes for NUMA_ALL_NODES. Pages already touched are migrated.
+// This is a no-op without libnuma.
+void place_numa_memory( void * ptr, size_t bytes, int node )
+{
+	#ifdef NUMA
+	if( ptr == NULL || bytes == 0 || numa_available() < 0 )
+		return;
+
+	// mbind works on whole pages
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	unsigned long start = (unsigned long) ptr & ~(page - 1);
+	unsigned long len = (unsigned long) ptr + bytes - start;
+
+	struct bitmask * mask = numa_allocate_nodemask();
+	if( node == NUMA_ALL_NODES )
+		copy_bitmask_to_bitmask( numa_all_nodes_ptr, mask );
+	else
+		numa_bitmask_setbit( mask, node );
+
+	if( mbind( (void *) start, len, node == NUMA_ALL_NODES ? MPOL_INTERLEAVE : MPOL_BIND,
+	           mask->maskp, mask->size + 1, MPOL_MF_MOVE ) != 0 )
+		perror("mbind");
+
+	numa_free_nodemask( mask );
+	#endif
+}
+
+// Node whose replica the calling thread reads. Simulated nodes take
+// equal blocks of threads, real ones are found from the thread's CPU, so
+// threads should be pinned (e.g. OMP_PROC_BIND=true).
+int thread_numa_node( LookupTables * lt, int thread, int nthreads )
+{
+	if( lt->numa_nodes <= 1 )
+		return 0;
+	if( lt->numa_fake )
+		return (int) ( (long) thread * lt->numa_nodes / nthreads );
+
+	int node = 0;
+	#ifdef NUMA
+	node = numa_node_of_cpu( sched_getcpu() );
+	#endif
+	if( node < 0 || node >= lt->numa_nodes )
+		node = 0;
+	return node;
+}
+
+// Rounds a file offset up to the section alignment
+static long binary_align( long offset )
+{
+	return ( offset + BINARY_ALIGN - 1 ) / BINARY_ALIGN * BINARY_ALIGN;
+}
+
+static void binary_error( const char * why )
+{
+	fprintf(stderr,"ERROR - \"XS_data.dat\" %s!\n", why);
+	exit(1);
+}
+
+// FNV-1a over bytes [0, n) of data, a word at a time, starting from hash
+static unsigned long binary_hash( const char * data, long n, unsigned long hash )
+{
+	long i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		unsigned long word;
+		memcpy( &word, data + i, sizeof(word) );
+		hash = ( hash ^ word ) * 0x100000001b3UL;
+	}
+	for( ; i < n; i++ )
+		hash = ( hash ^ (unsigned char) data[i] ) * 0x100000001b3UL;
+	return hash;
+}
+
+// Checksum of a mapped XS_data.dat: the hash of the header, with its
+// checksum zeroed, followed by the hashes of every BINARY_HASH_BLOCK of
+// the sections in file order. The blocks are hashed in parallel, and the
+// result does not depend on the number of threads.
+static unsigned long binary_checksum( const char * file )
+{
+	BinaryHeader h;
+	memcpy( &h, file, sizeof(h) );
+	h.checksum = 0;
+
+	const char * data = file + h.grid_offset;
+	long bytes = h.file_bytes - h.grid_offset;
+	long n_blocks = ( bytes + BINARY_HASH_BLOCK - 1 ) / BINARY_HASH_BLOCK;
+	unsigned long * block_hash = (unsigned long *) malloc( n_blocks * sizeof(unsigned long) );
+	if( block_hash == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	#pragma omp parallel for schedule(static)
+	for( long b = 0; b < n_blocks; b++ )
+	{
+		long n = bytes - b * BINARY_HASH_BLOCK;
+		if( n > BINARY_HASH_BLOCK )
+			n = BINARY_HASH_BLOCK;
+		block_hash[b] = binary_hash( data + b * BINARY_HASH_BLOCK, n, 0xcbf29ce484222325UL );
+	}
+
+	unsigned long hash = binary_hash( (const char *) &h, sizeof(h), 0xcbf29ce484222325UL );
+	for( long b = 0; b < n_blocks; b++ )
+		hash = ( hash ^ block_hash[b] ) * 0x100000001b3UL;
+	free( block_hash );
+	return hash;
+}
+
+// Writes the nuclide grids, the unionized grid energies and INDEX_INT
+// xs_ptrs when they are in use, and the material concentrations to
+// XS_data.dat (see BinaryHeader)
+void binary_dump( Inputs in, NuclideGridPoint ** nuclide_grids, GridPoint * energy_grid,
+                  int * num_nucs, double ** concs )
 {
-	FILE * fp = fopen("XS_data.dat", "wb");
-	// Dump Nuclide Grid Data
-	for( long i = 0; i < n_isotopes; i++ )
-		fwrite(nuclide_grids[i], sizeof(NuclideGridPoint), n_gridpoints, fp);
+	long n = in.n_isotopes * in.n_gridpoints;
+	long n_concs = 0;
+	for( int i = 0; i < 12; i++ )
+		n_concs += num_nucs[i];
 
-	if( grid_type == UNIONIZED )
+	BinaryHeader h;
+	memset( &h, 0, sizeof(h) );
+	memcpy( h.magic, BINARY_MAGIC, sizeof(h.magic) );
+	h.version = BINARY_VERSION;
+	h.grid_type = in.grid_type;
+	h.index_type = in.index_type;
+	h.point_bytes = sizeof(NuclideGridPoint);
+	h.n_isotopes = in.n_isotopes;
+	h.n_gridpoints = in.n_gridpoints;
+	h.grid_offset = binary_align( sizeof(h) );
+	h.file_bytes = h.grid_offset + n * sizeof(NuclideGridPoint);
+	if( in.grid_type == UNIONIZED )
 	{
-		// Dump UEG Data
-		for( long i = 0; i < n_isotopes * n_gridpoints; i++ )
+		h.energy_offset = binary_align( h.file_bytes );
+		h.file_bytes = h.energy_offset + n * sizeof(double);
+		if( in.index_type == INDEX_INT )
 		{
-			// Write energy level
-			fwrite(&energy_grid[i].energy, sizeof(double), 1, fp);
+			h.index_offset = binary_align( h.file_bytes );
+			h.file_bytes = h.index_offset + n * in.n_isotopes * sizeof(int);
+		}
+	}
+	h.concs_offset = binary_align( h.file_bytes );
+	h.n_concs = n_concs;
+	h.file_bytes = h.concs_offset + n_concs * sizeof(double);
+
+	FILE * fp = fopen("XS_data.dat", "w+b");
+	if( fp == NULL )
+		binary_error("could not be written");
+	if( ftruncate( fileno(fp), h.file_bytes ) != 0 )
+		binary_error("could not be written");
+
+	// The nuclide grids and the xs_ptrs are each one allocation. The
+	// header is rewritten with the checksum once the sections are in.
+	size_t written = fwrite( &h, sizeof(h), 1, fp ), expected = 1 + n;
+	fseek( fp, h.grid_offset, SEEK_SET );
+	written += fwrite( nuclide_grids[0], sizeof(NuclideGridPoint), n, fp );
+	if( h.energy_offset )
+	{
+		double buffer[4096];
+		fseek( fp, h.energy_offset, SEEK_SET );
+		for( long i = 0; i < n; i += 4096 )
+		{
+			long count = ( n - i < 4096 ) ? n - i : 4096;
+			for( long j = 0; j < count; j++ )
+				buffer[j] = energy_grid[i + j].energy;
+			written += fwrite( buffer, sizeof(double), count, fp );
+		}
+		expected += n;
+	}
+	if( h.index_offset )
+	{
+		fseek( fp, h.index_offset, SEEK_SET );
+		written += fwrite( energy_grid[0].xs_ptrs, sizeof(int) * in.n_isotopes, n, fp );
+		expected += n;
+	}
+	fseek( fp, h.concs_offset, SEEK_SET );
+	for( int i = 0; i < 12; i++ )
+		written += fwrite( concs[i], sizeof(double), num_nucs[i], fp );
+	expected += n_concs;
+	if( written != expected || fflush( fp ) != 0 )
+		binary_error("could not be written");
+
+	// Checksum the file as binary_read will see it
+	char * file = (char *) mmap( NULL, h.file_bytes, PROT_READ, MAP_SHARED, fileno(fp), 0 );
+	if( file == MAP_FAILED )
+		binary_error("could not be mapped");
+	h.checksum = binary_checksum( file );
+	munmap( file, h.file_bytes );
+
+	fseek( fp, 0, SEEK_SET );
+	if( fwrite( &h, sizeof(h), 1, fp ) != 1 || fclose( fp ) != 0 )
+		binary_error("could not be written");
+}
+
+// Maps XS_data.dat, as written by binary_dump, and returns the nuclide
+// grids in place in the mapping. For the unionized grid, energy_grid is
+// set to a new grid holding the file's energies, with its xs_ptrs
+// pointing into the mapping for INDEX_INT and NULL otherwise. concs_data
+// is set to the concentrations, for load_concs_binary. The mapping is
+// read only, so its pages stay shared with the page cache, and lasts
+// until exit.
+NuclideGridPoint ** binary_read( Inputs in, GridPoint ** energy_grid, double ** concs_data )
+{
+	long n = in.n_isotopes * in.n_gridpoints;
+
+	int fd = open("XS_data.dat", O_RDONLY);
+	if( fd < 0 )
+		binary_error("could not be opened");
+	struct stat st;
+	if( fstat( fd, &st ) != 0 || st.st_size < (off_t) sizeof(BinaryHeader) )
+		binary_error("is not an XSBench data file");
+
+	char * file = (char *) mmap( NULL, st.st_size, PROT_READ,
+	                             MAP_PRIVATE | MAP_POPULATE, fd, 0 );
+	close( fd );
+	if( file == MAP_FAILED )
+		binary_error("could not be mapped");
+	madvise( file, st.st_size, MADV_WILLNEED );
+
+	BinaryHeader * h = (BinaryHeader *) file;
+	if( memcmp( h->magic, BINARY_MAGIC, sizeof(h->magic) ) != 0 ||
+	    h->file_bytes != st.st_size )
+		binary_error("is not an XSBench data file");
+	if( h->version != BINARY_VERSION || h->point_bytes != sizeof(NuclideGridPoint) )
+		binary_error("was written by a different version of XSBench");
+	if( h->checksum != binary_checksum( file ) )
+		binary_error("is corrupt");
+
+	// Only the sections these inputs use need to be present
+	if( h->n_isotopes != in.n_isotopes || h->n_gridpoints != in.n_gridpoints ||
+	    ( in.grid_type == UNIONIZED && h->energy_offset == 0 ) ||
+	    ( in.grid_type == UNIONIZED && in.index_type == INDEX_INT && h->index_offset == 0 ) )
+		binary_error("does not match the inputs");
+
+	NuclideGridPoint * grids = (NuclideGridPoint *) ( file + h->grid_offset );
+	NuclideGridPoint ** M = (NuclideGridPoint **) alignedMalloc( in.n_isotopes *
+	                          sizeof(NuclideGridPoint *) );
+	for( long i = 0; i < in.n_isotopes; i++ )
+		M[i] = &grids[i * in.n_gridpoints];
+
+	*concs_data = (double *) ( file + h->concs_offset );
+	*energy_grid = NULL;
+	if( in.grid_type == UNIONIZED )
+	{
+		// GridPoint holds a pointer, so the energies are copied into one
+		const double * energy = (const double *) ( file + h->energy_offset );
+		int * index = NULL;
+		if( in.index_type == INDEX_INT )
+			index = (int *) ( file + h->index_offset );
 
-			// Write index data array (xs_ptrs array)
-			fwrite(energy_grid[i].xs_ptrs, sizeof(int), n_isotopes, fp);
+		GridPoint * grid = (GridPoint *) huge_malloc( n * sizeof(GridPoint), in.pages );
+		if( grid == NULL )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+		#pragma omp parallel for schedule(static)
+		for( long i = 0; i < n; i++ )
+		{
+			grid[i].energy = energy[i];
+			grid[i].xs_ptrs = index ? &index[i * in.n_isotopes] : NULL;
 		}
+		*energy_grid = grid;
 	}
 
-	fclose(fp);
+	return M;
 }
 
-void binary_read(long n_isotopes, long n_gridpoints, NuclideGridPoint ** nuclide_grids, GridPoint * energy_grid, int grid_type)
+// Sorts keys[0 .. n-1] into increasing order, moving ids along with them,
+// with a stable least significant digit radix sort. Must be called by
+// every thread of the enclosing parallel region: each thread counts and
+// scatters its own slice, and the slices are placed in thread order so
+// the sort stays stable. Digits shared by all keys (such as the exponent
+// bits of energies in [0,1)) are skipped. hist holds RADIX_BUCKETS counts
+// per thread, and tmp_keys / tmp_ids are scratch space for n entries.
+void sort_event_bank( long n, unsigned long * keys, int * ids,
+                      unsigned long * tmp_keys, int * tmp_ids, long * hist )
 {
-	int stat;
-	FILE * fp = fopen("XS_data.dat", "rb");
-	// Read Nuclide Grid Data
-	for( long i = 0; i < n_isotopes; i++ )
-		stat = fread(nuclide_grids[i], sizeof(NuclideGridPoint), n_gridpoints, fp);
+	int nthreads = omp_get_num_threads();
+	int thread = omp_get_thread_num();
+	long start = n * thread / nthreads;
+	long end = n * (thread + 1) / nthreads;
+	unsigned long * src_keys = keys, * dst_keys = tmp_keys;
+	int * src_ids = ids, * dst_ids = tmp_ids;
+	long * count = &hist[thread * RADIX_BUCKETS];
+	long offset[RADIX_BUCKETS];
 
-	if( grid_type == UNIONIZED )
+	for( int shift = 0; shift < 64; shift += RADIX_BITS )
 	{
-		// Dump UEG Data
-		for( long i = 0; i < n_isotopes * n_gridpoints; i++ )
+		for( int d = 0; d < RADIX_BUCKETS; d++ )
+			count[d] = 0;
+		for( long i = start; i < end; i++ )
+			count[(src_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+		#pragma omp barrier
+
+		// This thread's keys with digit d go after all keys with smaller
+		// digits, and after the earlier threads' keys with digit d
+		long total = 0;
+		bool skip = false;
+		for( int d = 0; d < RADIX_BUCKETS; d++ )
 		{
-			// Write energy level
-			stat = fread(&energy_grid[i].energy, sizeof(double), 1, fp);
+			long digit_total = 0;
+			for( int t = 0; t < nthreads; t++ )
+			{
+				if( t == thread )
+					offset[d] = total + digit_total;
+				digit_total += hist[t * RADIX_BUCKETS + d];
+			}
+			if( digit_total == n )
+				skip = true;
+			total += digit_total;
+		}
+
+		if( !skip )
+		{
+			for( long i = start; i < end; i++ )
+			{
+				long o = offset[(src_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				dst_keys[o] = src_keys[i];
+				dst_ids[o] = src_ids[i];
+			}
+
+			unsigned long * k = src_keys; src_keys = dst_keys; dst_keys = k;
+			int * v = src_ids; src_ids = dst_ids; dst_ids = v;
+		}
 
-			// Write index data array (xs_ptrs array)
-			stat = fread(energy_grid[i].xs_ptrs, sizeof(int), n_isotopes, fp);
+		// The scatter has to finish before the next pass reads it, and
+		// the counts before they are reset
+		#pragma omp barrier
+	}
+
+	if( src_keys != keys )
+	{
+		#pragma omp for schedule(static)
+		for( long i = 0; i < n; i++ )
+		{
+			keys[i] = src_keys[i];
+			ids[i] = src_ids[i];
 		}
 	}
+}
 
-	fclose(fp);
+// Return values of deque_steal besides a task
+#define DEQUE_EMPTY -1
+#define DEQUE_ABORT -2
 
+// Only called by the deque's owner
+static void deque_push( TaskDeque * d, int task )
+{
+	long b = __atomic_load_n( &d->bottom, __ATOMIC_RELAXED );
+	assert( b - __atomic_load_n( &d->top, __ATOMIC_ACQUIRE ) < d->capacity );
+	__atomic_store_n( &d->tasks[b % d->capacity], task, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	__atomic_store_n( &d->bottom, b + 1, __ATOMIC_RELAXED );
+}
+
+// Only called by the deque's owner. The last task races with the thieves
+// for the top, everything below it is the owner's alone.
+static long deque_pop( TaskDeque * d )
+{
+	long b = __atomic_load_n( &d->bottom, __ATOMIC_RELAXED ) - 1;
+	__atomic_store_n( &d->bottom, b, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	long t = __atomic_load_n( &d->top, __ATOMIC_RELAXED );
+
+	if( t > b )
+	{
+		__atomic_store_n( &d->bottom, b + 1, __ATOMIC_RELAXED );
+		return DEQUE_EMPTY;
+	}
+
+	long task = __atomic_load_n( &d->tasks[b % d->capacity], __ATOMIC_RELAXED );
+	if( t == b )
+	{
+		if( !__atomic_compare_exchange_n( &d->top, &t, t + 1, false,
+		                                  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+			task = DEQUE_EMPTY;
+		__atomic_store_n( &d->bottom, b + 1, __ATOMIC_RELAXED );
+	}
+	return task;
+}
+
+// Called by any thread. DEQUE_ABORT means another thread took the task.
+static long deque_steal( TaskDeque * d )
+{
+	long t = __atomic_load_n( &d->top, __ATOMIC_ACQUIRE );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+	long b = __atomic_load_n( &d->bottom, __ATOMIC_ACQUIRE );
+	if( t >= b )
+		return DEQUE_EMPTY;
+
+	long task = __atomic_load_n( &d->tasks[t % d->capacity], __ATOMIC_RELAXED );
+	if( !__atomic_compare_exchange_n( &d->top, &t, t + 1, false,
+	                                  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+		return DEQUE_ABORT;
+	return task;
+}
+
+// Work stealing scheduler for tasks 0 .. n_tasks-1. Each thread starts
+// with a contiguous block of them in its deque (see scheduler_fill), and
+// runs them in order. A thread whose deque is empty steals from the far
+// end of the others', trying them from a random one on.
+void scheduler_init( TaskScheduler * s, long n_tasks, int nthreads )
+{
+	s->nthreads = nthreads;
+	s->n_tasks = n_tasks;
+	s->untaken = n_tasks;
+	s->deques = (TaskDeque *) alignedMalloc( nthreads * sizeof(TaskDeque) );
+	if( s->deques == NULL )
+	{
+		fprintf(stderr,"ERROR - Out Of Memory!\n");
+		exit(1);
+	}
+
+	for( int t = 0; t < nthreads; t++ )
+	{
+		TaskDeque * d = &s->deques[t];
+		d->top = 0;
+		d->bottom = 0;
+		d->capacity = n_tasks / nthreads + 1;
+		d->tasks = (int *) malloc( d->capacity * sizeof(int) );
+		d->rng = t + 1;
+		d->steals = 0;
+		if( d->tasks == NULL )
+		{
+			fprintf(stderr,"ERROR - Out Of Memory!\n");
+			exit(1);
+		}
+	}
+}
+
+// Pushes the calling thread's block of tasks. Must be called by every
+// thread, followed by a barrier before the first scheduler_next.
+void scheduler_fill( TaskScheduler * s, int thread )
+{
+	long start = s->n_tasks * thread / s->nthreads;
+	long end = s->n_tasks * (thread + 1) / s->nthreads;
+
+	// Pushed backwards, so the owner pops them in order
+	for( long i = end - 1; i >= start; i-- )
+		deque_push( &s->deques[thread], (int) i );
+}
+
+// The calling thread's next task, or -1 once every task has been taken
+long scheduler_next( TaskScheduler * s, int thread )
+{
+	TaskDeque * own = &s->deques[thread];
+	long task = deque_pop( own );
+
+	while( task < 0 && __atomic_load_n( &s->untaken, __ATOMIC_RELAXED ) > 0 )
+	{
+		// xorshift victim pick
+		own->rng ^= own->rng << 13;
+		own->rng ^= own->rng >> 7;
+		own->rng ^= own->rng << 17;
+		int first = own->rng % s->nthreads;
+
+		for( int v = 0; v < s->nthreads && task < 0; v++ )
+		{
+			int victim = ( first + v ) % s->nthreads;
+			if( victim != thread )
+				task = deque_steal( &s->deques[victim] );
+		}
+
+		if( task >= 0 )
+			own->steals++;
+		else
+			__builtin_ia32_pause();
+	}
+
+	if( task >= 0 )
+		__atomic_sub_fetch( &s->untaken, 1, __ATOMIC_RELAXED );
+	return task;
+}
+
+void scheduler_free( TaskScheduler * s )
+{
+	for( int t = 0; t < s->nthreads; t++ )
+		free( s->deques[t].tasks );
+	alignedFree( s->deques );
+}
+
+// Lookups in the history of particle p. HISTORY_GEOMETRIC draws them
+// from a geometric distribution with the given mean, using a stream of
+// their own, so the particles' energies and materials are unchanged.
+int history_length( int history_lengths, int mean, long p )
+{
+	if( history_lengths == HISTORY_FIXED || mean <= 1 )
+		return mean;
+
+	// P(k) = q (1-q)^(k-1) for k >= 1, with q = 1 / mean
+	double u = rn_counter( HISTORY_LENGTH_SEED, p );
+	return 1 + (int) floor( log1p( -u ) / log1p( -1.0 / mean ) );
+}
+
+// Lookups over all of the particle histories
+long total_history_lookups( Inputs in )
+{
+	long total = 0;
+	for( long p = 0; p < in.particles; p++ )
+		total += history_length( in.history_lengths, in.lookups, p );
+	return total;
 }
 
 double rn(unsigned long * seed)
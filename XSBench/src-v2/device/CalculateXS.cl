@@ -6,9 +6,17 @@
 
 channel ulong RESULT_QUEUE __attribute__((depth(1)));
 
+// Unionized grid index element type. Build with -DXS_INDEX_SHORT to match
+// the host "-i short" option.
+#ifdef XS_INDEX_SHORT
+typedef ushort xs_index_t;
+#else
+typedef int xs_index_t;
+#endif
+
 __attribute__((max_global_work_dim(0)))
 __kernel void calculate_macro_xs_one(
-				__global const int *restrict energy_grid_xs,
+				__global const xs_index_t *restrict energy_grid_xs,
 				__global const double8 *restrict nuclide_grids,
 				__global ulong *restrict vhash)
 {
@@ -64,7 +72,7 @@ __kernel void calculate_macro_xs_one(
 
 __attribute__((max_global_work_dim(0)))
 __kernel void calculate_macro_xs_two(
-				__global int *restrict energy_grid_xs,
+				__global xs_index_t *restrict energy_grid_xs,
 				__global double8 *restrict nuclide_grids)
 {
 	ulong vhash_result = 0;
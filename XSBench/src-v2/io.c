@@ -41,7 +41,9 @@ void print_results( Inputs in, int mype, double runtime, int nprocs,
 {
 	// Calculate Lookups per sec
 	int lookups = 0;
-	if( in.simulation_method == HISTORY_BASED )
+	if( in.simulation_method == HISTORY_BASED && in.history_lengths != HISTORY_FIXED )
+		lookups = total_history_lookups( in );
+	else if( in.simulation_method == HISTORY_BASED )
 		lookups = in.lookups * in.particles;
 	else if( in.simulation_method == EVENT_BASED )
 		lookups = in.lookups;
@@ -111,6 +113,25 @@ void print_results( Inputs in, int mype, double runtime, int nprocs,
 	}
 }
 
+// Prints the time each thread spent running histories, out of the
+// simulation's runtime, and the histories it ran and stole
+void print_thread_times( int nthreads, double runtime, double * busy, long * histories, long * steals )
+{
+	printf("\n");
+	border_print();
+	center_print("THREAD BUSY TIMES", 79);
+	border_print();
+	printf("Thread    Busy (s)    Idle (s)    Histories    Steals\n");
+	for( int t = 0; t < nthreads; t++ )
+	{
+		printf("%6d  %10.3lf  %10.3lf  %11ld", t, busy[t], runtime - busy[t], histories[t]);
+		if( steals != NULL )
+			printf("  %8ld\n", steals[t]);
+		else
+			printf("         -\n");
+	}
+}
+
 void print_inputs(Inputs in, int nprocs, int version )
 {
 	// Calculate Estimate of Memory Usage
@@ -127,17 +148,29 @@ void print_inputs(Inputs in, int nprocs, int version )
 		printf("Simulation Method:            History Based\n");
 	if( in.grid_type == NUCLIDE )
 		printf("Grid Type:                    Nuclide Grid\n");
+	else if( in.grid_type == UNIONIZED && in.search_type == SEARCH_EYTZINGER )
+		printf("Grid Type:                    Unionized Grid (Eytzinger Search)\n");
+	else if( in.grid_type == UNIONIZED && in.search_type == SEARCH_BSCACHE )
+		printf("Grid Type:                    Unionized Grid (Cached Binary Search)\n");
+	else if( in.grid_type == UNIONIZED && in.search_type == SEARCH_KARY )
+		printf("Grid Type:                    Unionized Grid (K-ary SIMD Search)\n");
 	else if( in.grid_type == UNIONIZED )
 		printf("Grid Type:                    Unionized Grid\n");
-	else
+	else if( in.grid_type == HASH )
 		printf("Grid Type:                    Hash\n");
+	else
+		printf("Grid Type:                    Logarithmic Hash\n");
 
+	if( in.rng == RNG_COUNTER )
+		printf("XS Data Generator:            Counter Based (parallel)\n");
+	else
+		printf("XS Data Generator:            rand()\n");
 	printf("Materials:                    %d\n", 12);
 	printf("H-M Benchmark Size:           %s\n", in.HM);
 	printf("Total Nuclides:               %ld\n", in.n_isotopes);
 	printf("Gridpoints (per Nuclide):     ");
 	fancy_int(in.n_gridpoints);
-	if( in.grid_type == HASH )
+	if( in.grid_type == HASH || in.grid_type == LOGHASH )
 	{
 		printf("Hash Bins:                    ");
 		fancy_int(in.hash_bins);
@@ -146,6 +179,41 @@ void print_inputs(Inputs in, int nprocs, int version )
 	{
 		printf("Unionized Energy Gridpoints:  ");
 		fancy_int(in.n_isotopes*in.n_gridpoints);
+		if( in.index_type == INDEX_INT )
+			printf("Unionized Grid Index:         32-bit\n");
+		else if( in.index_type == INDEX_SHORT )
+			printf("Unionized Grid Index:         16-bit\n");
+		else if( in.index_type == INDEX_DELTA )
+			printf("Unionized Grid Index:         Base + 8-bit Delta\n");
+		else
+			printf("Unionized Grid Index:         32-bit, per Material\n");
+		if( in.layout == LAYOUT_SOA )
+			printf("Nuclide Grid Layout:          Structure of Arrays (SIMD)\n");
+		else if( in.layout == LAYOUT_SIMD )
+			printf("Nuclide Grid Layout:          Array of Structs (SIMD)\n");
+		else
+			printf("Nuclide Grid Layout:          Array of Structs\n");
+	}
+	if( in.interp == INTERP_SLOPE )
+		printf("Interpolation:                Slope Grid\n");
+	if( in.precision == PRECISION_MIXED )
+		printf("XS Precision:                 Mixed (double energy, float XS)\n");
+	if( in.kernels == KERNELS_GENERIC )
+		printf("Lookup Kernels:               Generic (options read per lookup)\n");
+	else if( in.kernels == KERNELS_BENCH )
+		printf("Lookup Kernels:               Benchmark (generic vs. specialized)\n");
+	if( in.tables == TABLES_MACRO )
+		printf("Macro XS Lookups:             Pre-summed Material Tables\n");
+	if( in.pages == PAGES_THP )
+		printf("Grid Pages:                   Transparent Huge Pages\n");
+	else if( in.pages == PAGES_HUGETLB )
+		printf("Grid Pages:                   hugetlbfs (THP fallback)\n");
+	if( in.numa != NUMA_NONE )
+	{
+		printf("NUMA Placement:               %s", in.numa == NUMA_INTERLEAVE ? "Interleaved" : "Replicated");
+		if( in.numa_nodes > 0 )
+			printf(" (%d simulated nodes)", in.numa_nodes);
+		printf("\n");
 	}
 	if( in.simulation_method == HISTORY_BASED )
 	{
@@ -153,6 +221,28 @@ void print_inputs(Inputs in, int nprocs, int version )
 		printf("XS Lookups per Particle:      "); fancy_int(in.lookups);
 	}
 	printf("Total XS Lookups:             "); fancy_int(in.lookups);
+	if( in.simulation_method == EVENT_BASED && in.batch > 0 )
+	{
+		printf("Lookups per Batch:            "); fancy_int(in.batch);
+	}
+	if( in.simulation_method == HISTORY_BASED && in.history_lengths == HISTORY_GEOMETRIC )
+		printf("History Lengths:              Geometric (mean %d)\n", in.lookups);
+	if( in.simulation_method == HISTORY_BASED && in.scheduler == SCHED_STEAL )
+		printf("Particle Scheduler:           Work Stealing\n");
+	if( in.simulation_method == HISTORY_BASED && in.lanes > 0 )
+	{
+		printf("Particles in Lockstep:        "); fancy_int(in.lanes);
+	}
+	if( in.simulation_method == EVENT_BASED && in.bank > 0 )
+	{
+		printf("Lookups per Sorted Bank:      "); fancy_int(in.bank);
+		if( in.queue == QUEUE_MATERIAL )
+			printf("Lookup Queues:                Per Material\n");
+	}
+	if( in.device == FPGA )
+		printf("Device:                       FPGA\n");
+	else
+		printf("Device:                       Host\n");
 	#ifdef MPI
 	printf("MPI Ranks:                    %d\n", nprocs);
 	printf("OMP Threads per MPI Rank:     %d\n", in.nthreads);
@@ -203,10 +293,27 @@ void print_CLI_error(void)
 	printf("  -t <threads>             Number of OpenMP threads to run\n");
 	printf("  -s <size>                Size of H-M Benchmark to run (small, large, XL, XXL)\n");
 	printf("  -g <gridpoints>          Number of gridpoints per nuclide (overrides -s defaults)\n");
-	printf("  -G <grid type>           Grid search type (unionized, nuclide, hash). Defaults to unionized.\n");
+	printf("  -G <grid type>           Grid search type (unionized, bscache, eytzinger, kary, nuclide, hash, loghash). Defaults to unionized.\n");
 	printf("  -p <particles>           Number of particle histories\n");
 	printf("  -l <lookups>             History Based: Number of Cross-section (XS) lookups per particle. Event Based: Total number of XS lookups.\n");
-	printf("  -h <hash bins>           Number of hash bins (only relevant when used with \"-G hash\")\n");
+	printf("  -h <hash bins>           Number of hash bins (only relevant when used with \"-G hash\" or \"-G loghash\")\n");
+	printf("  -i <index type>          Unionized grid index encoding (int, short, delta, material). material keeps one row per material. Defaults to int.\n");
+	printf("  -d <device>              Device to run the lookups on (fpga, host). fpga runs the default unionized lookups, with the int or short index. Defaults to fpga.\n");
+	printf("  -r <generator>           RNG for the XS data (rand, counter). counter generates in parallel. Defaults to rand.\n");
+	printf("  -L <layout>              Nuclide grid layout for unionized lookups (aos, simd, soa). simd and soa use SIMD gathers. Defaults to aos.\n");
+	printf("  -I <interpolation>       Micro XS interpolation (lerp, slope). slope precomputes the XS slopes of each grid interval. Defaults to lerp.\n");
+	printf("  -P <precision>           XS data precision (double, mixed). mixed stores the XS and concentrations as float. Defaults to double.\n");
+	printf("  -T <tables>              Macro XS lookups (none, macro). macro interpolates pre-summed per material tables. Defaults to none.\n");
+	printf("  -H <pages>               Pages backing the grids (none, thp, hugetlb). hugetlb falls back to thp. Defaults to none.\n");
+	printf("  -N <numa>                NUMA placement of the XS data (none, interleave, replicate). replicate gives each node a copy of the grids, for the default index, search, layout, interpolation and precision only. Defaults to none.\n");
+	printf("  -F <nodes>               Simulate this many NUMA nodes for \"-N replicate\", splitting the threads evenly over them. Defaults to the machine's.\n");
+	printf("  -k <kernels>             Host lookup kernels (specialized, generic, bench). generic branches on the grid type, index, search and layout per lookup. bench times both on each grid type. Defaults to specialized.\n");
+	printf("  -B <batch>               Event Based: Interleave the lookups in batches of up to 64. Defaults to 0 (off).\n");
+	printf("  -W <lanes>               History Based: Advance this many particles (up to 64) in lockstep, interleaving their lookups. Defaults to 0 (off).\n");
+	printf("  -S <scheduler>           History Based: Share out the particles with (omp, steal). steal uses per thread work stealing deques. Defaults to omp.\n");
+	printf("  -V <lengths>             History Based: Lookups per particle (fixed, geometric). geometric draws them with a mean of -l. Defaults to fixed.\n");
+	printf("  -e <bank>                Event Based: Run the lookups in banks of this many, sorted by energy. Defaults to 0 (off).\n");
+	printf("  -q <queues>              Event Based: Queue each bank's lookups (none, material). material also needs \"-e\". Defaults to none.\n");
 	printf("Default is equivalent to: -m history -s large -l 34 -p 500000 -G unionized\n");
 	printf("See readme for full description of default run values\n");
 	exit(4);
@@ -239,6 +346,57 @@ Inputs read_CLI( int argc, char * argv[] )
 
 	// default to unionized grid
 	input.hash_bins = 10000;
+
+	// defaults to 32-bit unionized grid indices
+	input.index_type = INDEX_INT;
+
+	// defaults to running the lookups on the FPGA
+	input.device = FPGA;
+
+	// defaults to generating the XS data with rand()
+	input.rng = RNG_RAND;
+
+	// defaults to a binary search of the unionized grid
+	input.search_type = SEARCH_BINARY;
+
+	// defaults to one lookup per calculate_macro_xs call
+	input.batch = 0;
+
+	// defaults to one particle history at a time
+	input.lanes = 0;
+
+	// defaults to OpenMP guided scheduling of histories of equal length
+	input.scheduler = SCHED_OMP;
+	input.history_lengths = HISTORY_FIXED;
+
+	// defaults to running the event based lookups unsorted
+	input.bank = 0;
+
+	// defaults to one queue for all materials
+	input.queue = QUEUE_NONE;
+
+	// defaults to the array of NuclideGridPoint structs
+	input.layout = LAYOUT_AOS;
+
+	// defaults to interpolating between two NuclideGridPoints
+	input.interp = INTERP_LERP;
+
+	// defaults to double precision XS data
+	input.precision = PRECISION_DOUBLE;
+
+	// defaults to lookups specialised on the grid type
+	input.kernels = KERNELS_SPECIALIZED;
+
+	// defaults to summing the micro XS in every lookup
+	input.tables = TABLES_NONE;
+
+	// defaults to the grids on the system's base pages
+	input.pages = PAGES_NONE;
+
+	// defaults to leaving the XS data where it is first touched, on the
+	// machine's NUMA nodes
+	input.numa = NUMA_NONE;
+	input.numa_nodes = 0;
 	
 	// defaults to H-M Large benchmark
 	input.HM = (char *) malloc( 6 * sizeof(char) );
@@ -355,10 +513,279 @@ Inputs read_CLI( int argc, char * argv[] )
 
 			if( strcmp(grid_type, "unionized") == 0 )
 				input.grid_type = UNIONIZED;
+			else if( strcmp(grid_type, "bscache") == 0 )
+			{
+				input.grid_type = UNIONIZED;
+				input.search_type = SEARCH_BSCACHE;
+			}
+			else if( strcmp(grid_type, "eytzinger") == 0 )
+			{
+				input.grid_type = UNIONIZED;
+				input.search_type = SEARCH_EYTZINGER;
+			}
+			else if( strcmp(grid_type, "kary") == 0 )
+			{
+				input.grid_type = UNIONIZED;
+				input.search_type = SEARCH_KARY;
+			}
 			else if( strcmp(grid_type, "nuclide") == 0 )
 				input.grid_type = NUCLIDE;
 			else if( strcmp(grid_type, "hash") == 0 )
 				input.grid_type = HASH;
+			else if( strcmp(grid_type, "loghash") == 0 )
+				input.grid_type = LOGHASH;
+			else
+				print_CLI_error();
+		}
+		// index type (-i)
+		else if( strcmp(arg, "-i") == 0 )
+		{
+			char * index_type;
+			if( ++i < argc )
+				index_type = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(index_type, "int") == 0 )
+				input.index_type = INDEX_INT;
+			else if( strcmp(index_type, "short") == 0 )
+				input.index_type = INDEX_SHORT;
+			else if( strcmp(index_type, "delta") == 0 )
+				input.index_type = INDEX_DELTA;
+			else if( strcmp(index_type, "material") == 0 )
+				input.index_type = INDEX_MATERIAL;
+			else
+				print_CLI_error();
+		}
+		// data generator (-r)
+		else if( strcmp(arg, "-r") == 0 )
+		{
+			char * rng;
+			if( ++i < argc )
+				rng = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(rng, "rand") == 0 )
+				input.rng = RNG_RAND;
+			else if( strcmp(rng, "counter") == 0 )
+				input.rng = RNG_COUNTER;
+			else
+				print_CLI_error();
+		}
+		// device (-d)
+		else if( strcmp(arg, "-d") == 0 )
+		{
+			char * device;
+			if( ++i < argc )
+				device = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(device, "fpga") == 0 )
+				input.device = FPGA;
+			else if( strcmp(device, "host") == 0 )
+				input.device = HOST;
+			else
+				print_CLI_error();
+		}
+		// lookup batch size (-B)
+		else if( strcmp(arg, "-B") == 0 )
+		{
+			if( ++i < argc )
+				input.batch = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// history lanes (-W)
+		else if( strcmp(arg, "-W") == 0 )
+		{
+			if( ++i < argc )
+				input.lanes = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// history scheduler (-S)
+		else if( strcmp(arg, "-S") == 0 )
+		{
+			char * scheduler;
+			if( ++i < argc )
+				scheduler = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(scheduler, "omp") == 0 )
+				input.scheduler = SCHED_OMP;
+			else if( strcmp(scheduler, "steal") == 0 )
+				input.scheduler = SCHED_STEAL;
+			else
+				print_CLI_error();
+		}
+		// history lengths (-V)
+		else if( strcmp(arg, "-V") == 0 )
+		{
+			char * lengths;
+			if( ++i < argc )
+				lengths = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(lengths, "fixed") == 0 )
+				input.history_lengths = HISTORY_FIXED;
+			else if( strcmp(lengths, "geometric") == 0 )
+				input.history_lengths = HISTORY_GEOMETRIC;
+			else
+				print_CLI_error();
+		}
+		// energy sorted bank size (-e)
+		else if( strcmp(arg, "-e") == 0 )
+		{
+			if( ++i < argc )
+				input.bank = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// lookup queues (-q)
+		else if( strcmp(arg, "-q") == 0 )
+		{
+			char * queue;
+			if( ++i < argc )
+				queue = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(queue, "none") == 0 )
+				input.queue = QUEUE_NONE;
+			else if( strcmp(queue, "material") == 0 )
+				input.queue = QUEUE_MATERIAL;
+			else
+				print_CLI_error();
+		}
+		// nuclide grid layout (-L)
+		else if( strcmp(arg, "-L") == 0 )
+		{
+			char * layout;
+			if( ++i < argc )
+				layout = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(layout, "aos") == 0 )
+				input.layout = LAYOUT_AOS;
+			else if( strcmp(layout, "simd") == 0 )
+				input.layout = LAYOUT_SIMD;
+			else if( strcmp(layout, "soa") == 0 )
+				input.layout = LAYOUT_SOA;
+			else
+				print_CLI_error();
+		}
+		// interpolation (-I)
+		else if( strcmp(arg, "-I") == 0 )
+		{
+			char * interp;
+			if( ++i < argc )
+				interp = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(interp, "lerp") == 0 )
+				input.interp = INTERP_LERP;
+			else if( strcmp(interp, "slope") == 0 )
+				input.interp = INTERP_SLOPE;
+			else
+				print_CLI_error();
+		}
+		// XS precision (-P)
+		else if( strcmp(arg, "-P") == 0 )
+		{
+			char * precision;
+			if( ++i < argc )
+				precision = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(precision, "double") == 0 )
+				input.precision = PRECISION_DOUBLE;
+			else if( strcmp(precision, "mixed") == 0 )
+				input.precision = PRECISION_MIXED;
+			else
+				print_CLI_error();
+		}
+		// macro XS tables (-T)
+		else if( strcmp(arg, "-T") == 0 )
+		{
+			char * tables;
+			if( ++i < argc )
+				tables = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(tables, "none") == 0 )
+				input.tables = TABLES_NONE;
+			else if( strcmp(tables, "macro") == 0 )
+				input.tables = TABLES_MACRO;
+			else
+				print_CLI_error();
+		}
+		// grid pages (-H)
+		else if( strcmp(arg, "-H") == 0 )
+		{
+			char * pages;
+			if( ++i < argc )
+				pages = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(pages, "none") == 0 )
+				input.pages = PAGES_NONE;
+			else if( strcmp(pages, "thp") == 0 )
+				input.pages = PAGES_THP;
+			else if( strcmp(pages, "hugetlb") == 0 )
+				input.pages = PAGES_HUGETLB;
+			else
+				print_CLI_error();
+		}
+		// NUMA placement (-N)
+		else if( strcmp(arg, "-N") == 0 )
+		{
+			char * numa;
+			if( ++i < argc )
+				numa = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(numa, "none") == 0 )
+				input.numa = NUMA_NONE;
+			else if( strcmp(numa, "interleave") == 0 )
+				input.numa = NUMA_INTERLEAVE;
+			else if( strcmp(numa, "replicate") == 0 )
+				input.numa = NUMA_REPLICATE;
+			else
+				print_CLI_error();
+		}
+		// simulated NUMA nodes (-F)
+		else if( strcmp(arg, "-F") == 0 )
+		{
+			if( ++i < argc )
+				input.numa_nodes = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
+		// Lookup kernels (-k)
+		else if( strcmp(arg, "-k") == 0 )
+		{
+			char * kernels;
+			if( ++i < argc )
+				kernels = argv[i];
+			else
+				print_CLI_error();
+
+			if( strcmp(kernels, "specialized") == 0 )
+				input.kernels = KERNELS_SPECIALIZED;
+			else if( strcmp(kernels, "generic") == 0 )
+				input.kernels = KERNELS_GENERIC;
+			else if( strcmp(kernels, "bench") == 0 )
+				input.kernels = KERNELS_BENCH;
 			else
 				print_CLI_error();
 		}
@@ -387,6 +814,79 @@ Inputs read_CLI( int argc, char * argv[] )
 	// Validate Hash Bins 
 	if( input.hash_bins < 1 )
 		print_CLI_error();
+
+	// Validate batch size
+	if( input.batch < 0 || input.batch > MAX_BATCH )
+		print_CLI_error();
+
+	// Validate history lanes. They are looked up as one batch.
+	if( input.lanes < 0 || input.lanes > MAX_BATCH )
+		print_CLI_error();
+
+	// The lockstep lanes run whole groups of equal length histories
+	if( input.lanes > 0 && ( input.scheduler == SCHED_STEAL ||
+	                         input.history_lengths != HISTORY_FIXED ) )
+		print_CLI_error();
+
+	// Validate bank size. The sorted banks replace the batched lookups.
+	if( input.bank < 0 )
+		print_CLI_error();
+	if( input.bank > 0 && input.batch > 0 )
+		print_CLI_error();
+
+	// The macro tables are double precision
+	if( input.tables == TABLES_MACRO && input.precision == PRECISION_MIXED )
+		print_CLI_error();
+
+	// Simulated NUMA nodes have no memory of their own, so they only
+	// decide which replica each thread reads
+	if( input.numa_nodes < 0 )
+		print_CLI_error();
+	if( input.numa_nodes > 0 && input.numa != NUMA_REPLICATE )
+		print_CLI_error();
+
+	// Only the grids and the int xs_ptrs are replicated. The tables of the
+	// other index types, searches, layouts, interpolation, precision and
+	// macro XS would all be read from node 0.
+	if( input.numa == NUMA_REPLICATE &&
+	    ( input.index_type != INDEX_INT || input.search_type != SEARCH_BINARY ||
+	      input.layout != LAYOUT_AOS || input.interp != INTERP_LERP ||
+	      input.precision != PRECISION_DOUBLE || input.tables != TABLES_NONE ) )
+		print_CLI_error();
+
+	// The benchmark runs the lookups on the grids, and on grids that the
+	// replicas do not hold
+	if( input.kernels == KERNELS_BENCH &&
+	    ( input.tables == TABLES_MACRO || input.numa == NUMA_REPLICATE ) )
+		print_CLI_error();
+
+	// The material queues partition the sorted banks
+	if( input.queue == QUEUE_MATERIAL && input.bank == 0 )
+		print_CLI_error();
+
+	// The batches, banks and queues only drive the event based loop, and
+	// the lockstep lanes, scheduler and history lengths only the history
+	// based one
+	if( input.simulation_method == HISTORY_BASED &&
+	    ( input.batch > 0 || input.bank > 0 || input.queue != QUEUE_NONE ) )
+		print_CLI_error();
+	if( input.simulation_method == EVENT_BASED &&
+	    ( input.lanes > 0 || input.scheduler != SCHED_OMP ||
+	      input.history_lengths != HISTORY_FIXED ) )
+		print_CLI_error();
+
+	// The FPGA kernels only implement the unionized grid binary search over
+	// double precision NuclideGridPoints with the int and short indices.
+	// Everything else is a host-only option.
+	if( input.device == FPGA &&
+	    ( input.index_type == INDEX_DELTA || input.index_type == INDEX_MATERIAL ||
+	      input.grid_type != UNIONIZED || input.search_type != SEARCH_BINARY ||
+	      input.layout != LAYOUT_AOS || input.interp != INTERP_LERP ||
+	      input.precision != PRECISION_DOUBLE || input.tables != TABLES_NONE ||
+	      input.kernels != KERNELS_SPECIALIZED || input.numa == NUMA_REPLICATE ||
+	      input.batch > 0 || input.lanes > 0 || input.bank > 0 ||
+	      input.scheduler == SCHED_STEAL || input.history_lengths != HISTORY_FIXED ) )
+		print_CLI_error();
 	
 	// Validate HM size
 	if( strcasecmp(input.HM, "small") != 0 &&
@@ -404,6 +904,39 @@ Inputs read_CLI( int argc, char * argv[] )
 	else if( strcasecmp(input.HM, "XXL") == 0 && user_g == 0 )
 		input.n_gridpoints = 238847 * 2.1; // 252 GB XS data
 
+	// Validate index type. 16-bit indices can only address grids of up
+	// to 65536 points, and the compact encodings are only built for the
+	// unionized grid.
+	if( input.index_type == INDEX_SHORT && input.n_gridpoints > 65536 )
+		print_CLI_error();
+	if( input.index_type != INDEX_INT && input.grid_type != UNIONIZED )
+		print_CLI_error();
+
+	// The SIMD nuclide lookups are only implemented for the unionized grid,
+	// and interpolate from their own copies of the nuclide grids
+	if( input.layout != LAYOUT_AOS && input.grid_type != UNIONIZED )
+		print_CLI_error();
+	if( input.layout != LAYOUT_AOS && input.interp == INTERP_SLOPE )
+		print_CLI_error();
+
+	// The SIMD nuclide lookups gather with 32-bit offsets of
+	// (nuc * n_gridpoints + point) * stride doubles
+	long simd_stride = ( input.layout == LAYOUT_SIMD ) ? sizeof(NuclideGridPoint) / sizeof(double) : 1;
+	if( input.layout != LAYOUT_AOS &&
+	    input.n_isotopes * input.n_gridpoints * simd_stride >= 2147483648L )
+		print_CLI_error();
+
+	// The SIMD nuclide lookups gather the xs_ptrs by nuclide, which the
+	// per-material index does not store
+	if( input.layout != LAYOUT_AOS && input.index_type == INDEX_MATERIAL )
+		print_CLI_error();
+
+	// Mixed precision has its own copy of the nuclide grids, and is only
+	// implemented for the standard interpolation
+	if( input.precision == PRECISION_MIXED &&
+	    ( input.layout != LAYOUT_AOS || input.interp != INTERP_LERP ) )
+		print_CLI_error();
+
 	// Return input struct
 	return input;
 }